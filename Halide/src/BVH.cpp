@@ -0,0 +1,139 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+void BVH::Build(const std::vector<AABB>& primitiveBounds)
+{
+	Clear();
+	if (primitiveBounds.empty())
+		return;
+
+	uint32_t count = (uint32_t)primitiveBounds.size();
+	m_PrimitiveIndices.resize(count);
+	std::vector<glm::vec3> centroids(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_PrimitiveIndices[i] = i;
+		centroids[i] = primitiveBounds[i].Center();
+	}
+
+	m_Nodes.reserve(2 * (size_t)count);
+	Node& root = m_Nodes.emplace_back();
+	root.LeftOrFirst = 0;
+	root.Count = count;
+	UpdateBounds(0, primitiveBounds);
+	Subdivide(0, 0, primitiveBounds, centroids);
+
+	m_Nodes.shrink_to_fit();
+}
+
+void BVH::UpdateBounds(uint32_t nodeIndex, const std::vector<AABB>& primitiveBounds)
+{
+	Node& node = m_Nodes[nodeIndex];
+	node.Bounds = AABB();
+	for (uint32_t i = 0; i < node.Count; i++)
+		node.Bounds.Grow(primitiveBounds[m_PrimitiveIndices[node.LeftOrFirst + i]]);
+}
+
+void BVH::Subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds, const std::vector<glm::vec3>& centroids)
+{
+	// Copies, m_Nodes may reallocate below
+	uint32_t first = m_Nodes[nodeIndex].LeftOrFirst;
+	uint32_t count = m_Nodes[nodeIndex].Count;
+	if (count <= 2 || depth >= MaxDepth)
+		return;
+
+	AABB centroidBounds;
+	for (uint32_t i = 0; i < count; i++)
+		centroidBounds.Grow(centroids[m_PrimitiveIndices[first + i]]);
+
+	// Binned SAH over all three axes
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::max();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float minCentroid = centroidBounds.Min[axis];
+		float extent = centroidBounds.Max[axis] - minCentroid;
+		if (extent <= 0.0f)
+			continue;
+
+		AABB binBounds[BinCount];
+		uint32_t binCounts[BinCount] = {};
+		float scale = (float)BinCount / extent;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t primitive = m_PrimitiveIndices[first + i];
+			uint32_t bin = std::min(BinCount - 1, (uint32_t)((centroids[primitive][axis] - minCentroid) * scale));
+			binCounts[bin]++;
+			binBounds[bin].Grow(primitiveBounds[primitive]);
+		}
+
+		float leftArea[BinCount - 1], rightArea[BinCount - 1];
+		uint32_t leftCount[BinCount - 1], rightCount[BinCount - 1];
+		AABB leftBox, rightBox;
+		uint32_t leftSum = 0, rightSum = 0;
+		for (uint32_t i = 0; i < BinCount - 1; i++)
+		{
+			leftSum += binCounts[i];
+			leftCount[i] = leftSum;
+			leftBox.Grow(binBounds[i]);
+			leftArea[i] = leftBox.Valid() ? leftBox.HalfArea() : 0.0f;
+
+			rightSum += binCounts[BinCount - 1 - i];
+			rightCount[BinCount - 2 - i] = rightSum;
+			rightBox.Grow(binBounds[BinCount - 1 - i]);
+			rightArea[BinCount - 2 - i] = rightBox.Valid() ? rightBox.HalfArea() : 0.0f;
+		}
+
+		for (uint32_t i = 0; i < BinCount - 1; i++)
+		{
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+		return;
+
+	float leafCost = (float)count * m_Nodes[nodeIndex].Bounds.HalfArea();
+	if (bestCost >= leafCost && count <= MaxLeafSize)
+		return;
+
+	// Partition the index range around the chosen bin boundary
+	float minCentroid = centroidBounds.Min[bestAxis];
+	float scale = (float)BinCount / (centroidBounds.Max[bestAxis] - minCentroid);
+	uint32_t i = first, end = first + count;
+	while (i < end)
+	{
+		uint32_t bin = std::min(BinCount - 1, (uint32_t)((centroids[m_PrimitiveIndices[i]][bestAxis] - minCentroid) * scale));
+		if (bin <= bestSplit)
+			i++;
+		else
+			std::swap(m_PrimitiveIndices[i], m_PrimitiveIndices[--end]);
+	}
+
+	uint32_t leftCount = i - first;
+	if (leftCount == 0 || leftCount == count)
+		return;
+
+	uint32_t leftIndex = (uint32_t)m_Nodes.size();
+	m_Nodes.emplace_back();
+	m_Nodes.emplace_back();
+	m_Nodes[leftIndex].LeftOrFirst = first;
+	m_Nodes[leftIndex].Count = leftCount;
+	m_Nodes[leftIndex + 1].LeftOrFirst = i;
+	m_Nodes[leftIndex + 1].Count = count - leftCount;
+	m_Nodes[nodeIndex].LeftOrFirst = leftIndex;
+	m_Nodes[nodeIndex].Count = 0;
+
+	UpdateBounds(leftIndex, primitiveBounds);
+	UpdateBounds(leftIndex + 1, primitiveBounds);
+	Subdivide(leftIndex, depth + 1, primitiveBounds, centroids);
+	Subdivide(leftIndex + 1, depth + 1, primitiveBounds, centroids);
+}
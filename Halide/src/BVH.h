@@ -0,0 +1,133 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "Ray.h"
+
+struct AABB
+{
+	glm::vec3 Min{ std::numeric_limits<float>::max() };
+	glm::vec3 Max{ -std::numeric_limits<float>::max() };
+
+	void Grow(const glm::vec3& point) { Min = glm::min(Min, point); Max = glm::max(Max, point); }
+	void Grow(const AABB& other) { Min = glm::min(Min, other.Min); Max = glm::max(Max, other.Max); }
+
+	glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+	float HalfArea() const
+	{
+		glm::vec3 e = Max - Min;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+	bool Valid() const { return Min.x <= Max.x; }
+
+	// Slab test, returns the entry distance or a negative value on a miss
+	float Intersect(const Ray& ray, const glm::vec3& invDirection, float tMax) const
+	{
+		glm::vec3 t0 = (Min - ray.Origin) * invDirection;
+		glm::vec3 t1 = (Max - ray.Origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+		return entry <= exit ? entry : -1.0f;
+	}
+};
+
+// Binned-SAH bounding volume hierarchy over primitive bounds. Leaves reference primitives
+// through an index list so callers keep their own storage order.
+class BVH
+{
+public:
+	struct Node
+	{
+		AABB Bounds;
+		uint32_t LeftOrFirst = 0; // Left child for inner nodes, first primitive for leaves
+		uint32_t Count = 0;       // 0 for inner nodes
+
+		bool IsLeaf() const { return Count > 0; }
+	};
+
+	void Build(const std::vector<AABB>& primitiveBounds);
+	void Clear() { m_Nodes.clear(); m_PrimitiveIndices.clear(); }
+
+	bool Empty() const { return m_Nodes.empty(); }
+	const AABB& GetBounds() const { return m_Nodes[0].Bounds; }
+	size_t GetMemorySize() const { return m_Nodes.size() * sizeof(Node) + m_PrimitiveIndices.size() * sizeof(uint32_t); }
+
+	// Closest-hit traversal. intersect(primitiveIndex, tMax) shrinks tMax when it finds a closer hit.
+	template<typename IntersectFn>
+	void Traverse(const Ray& ray, float& tMax, IntersectFn&& intersect) const;
+
+private:
+	void UpdateBounds(uint32_t nodeIndex, const std::vector<AABB>& primitiveBounds);
+	void Subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds, const std::vector<glm::vec3>& centroids);
+
+	static constexpr uint32_t MaxDepth = 60;
+	static constexpr uint32_t MaxLeafSize = 8;
+	static constexpr uint32_t BinCount = 12;
+
+private:
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_PrimitiveIndices;
+};
+
+template<typename IntersectFn>
+void BVH::Traverse(const Ray& ray, float& tMax, IntersectFn&& intersect) const
+{
+	if (m_Nodes.empty())
+		return;
+
+	glm::vec3 invDirection = 1.0f / ray.Direction;
+	if (m_Nodes[0].Bounds.Intersect(ray, invDirection, tMax) < 0.0f)
+		return;
+
+	uint32_t stack[MaxDepth + 4];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+	while (true)
+	{
+		const Node& node = m_Nodes[nodeIndex];
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = 0; i < node.Count; i++)
+				intersect(m_PrimitiveIndices[node.LeftOrFirst + i], tMax);
+		}
+		else
+		{
+			// Visit the nearer child first, push the farther one
+			uint32_t near = node.LeftOrFirst, far = node.LeftOrFirst + 1;
+			float tNear = m_Nodes[near].Bounds.Intersect(ray, invDirection, tMax);
+			float tFar = m_Nodes[far].Bounds.Intersect(ray, invDirection, tMax);
+			if (tFar >= 0.0f && (tNear < 0.0f || tFar < tNear))
+			{
+				std::swap(near, far);
+				std::swap(tNear, tFar);
+			}
+
+			if (tNear >= 0.0f)
+			{
+				if (tFar >= 0.0f)
+					stack[stackSize++] = far;
+				nodeIndex = near;
+				continue;
+			}
+		}
+
+		// Pop, skipping nodes that a closer hit has made irrelevant
+		bool found = false;
+		while (stackSize > 0)
+		{
+			nodeIndex = stack[--stackSize];
+			if (m_Nodes[nodeIndex].Bounds.Intersect(ray, invDirection, tMax) >= 0.0f)
+			{
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+			return;
+	}
+}
@@ -5,10 +5,16 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <atomic>
+#include <cmath>
+
+#ifndef HALIDE_HEADLESS
 #include "Walnut/Input/Input.h"
 
 using namespace Walnut;
+#endif
 
+static std::atomic<uint64_t> s_NextVersion{ 1 };
 
 Camera::Camera(float verticalFOV, float nearClip, float farClip)
 	: m_VerticalFOV(verticalFOV), m_NearClip(nearClip), m_FarClip(farClip) // Frustum view
@@ -19,6 +25,10 @@ Camera::Camera(float verticalFOV, float nearClip, float farClip)
 
 bool Camera::OnUpdate(float ts)
 {
+#ifdef HALIDE_HEADLESS
+	(void)ts;
+	return false;
+#else
 	glm::vec2 mousePos = Input::GetMousePosition();
 	glm::vec2 delta = (mousePos - m_LastMousePosition) * 0.002f;
 	m_LastMousePosition = mousePos;
@@ -88,6 +98,28 @@ bool Camera::OnUpdate(float ts)
 		RecalculateRayDirections();
 	}
 	return moved;
+#endif
+}
+
+void Camera::SetView(const glm::vec3& position, const glm::vec3& forwardDirection)
+{
+	m_Position = position;
+	m_ForwardDirection = glm::normalize(forwardDirection);
+
+	RecalculateView();
+	if (m_ViewportWidth && m_ViewportHeight)
+		RecalculateRayDirections();
+}
+
+bool Camera::IsValidForward(const glm::vec3& forwardDirection)
+{
+	float lengthSquared = glm::dot(forwardDirection, forwardDirection);
+	if (!(lengthSquared > 0.0f) || !std::isfinite(lengthSquared))
+		return false;
+
+	// lookAt builds its right vector from this cross product
+	glm::vec3 right = glm::cross(forwardDirection / std::sqrt(lengthSquared), glm::vec3(0, 1, 0));
+	return glm::dot(right, right) > 1e-6f;
 }
 
 void Camera::OnResize(uint32_t width, uint32_t height)
@@ -110,12 +142,23 @@ void Camera::RecalculateProjection()
 {
 	m_Projection = glm::perspectiveFov(glm::radians(m_VerticalFOV), (float)m_ViewportWidth, (float)m_ViewportHeight, m_NearClip, m_FarClip);
 	m_InverseProjection = glm::inverse(m_Projection);
+	m_Version = s_NextVersion++;
 }
 
 void Camera::RecalculateView()
 {
 	m_View = glm::lookAt(m_Position, m_Position + m_ForwardDirection, glm::vec3(0, 1, 0));
 	m_InverseView = glm::inverse(m_View);
+	m_Version = s_NextVersion++;
+}
+
+glm::vec3 Camera::GetRayDirection(const glm::vec2& pixel) const
+{
+	glm::vec2 coord = pixel / glm::vec2((float)m_ViewportWidth, (float)m_ViewportHeight);
+	coord = coord * 2.0f - 1.0f;
+
+	glm::vec4 target = m_InverseProjection * glm::vec4(coord.x, coord.y, 1, 1);
+	return glm::vec3(m_InverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0)); // World Space
 }
 
 void Camera::RecalculateRayDirections()
@@ -10,6 +10,11 @@ public:
 
 	bool OnUpdate(float ts);
 	void OnResize(uint32_t width, uint32_t height);
+	// Places the camera directly, for scripted (non-interactive) renders
+	void SetView(const glm::vec3& position, const glm::vec3& forwardDirection);
+	// SetView needs a finite, nonzero forward that is not parallel to world up, the view
+	// matrix is degenerate otherwise
+	static bool IsValidForward(const glm::vec3& forwardDirection);
 
 	const glm::mat4& GetProjection() const { return m_Projection;  }
 	const glm::mat4& GetInverseProjection() const { return m_InverseProjection; }
@@ -18,8 +23,15 @@ public:
 
 	const glm::vec3& GetPosition() const { return m_Position; }
 	const glm::vec3& GetDirection() const { return m_ForwardDirection; }
+	float GetVerticalFOV() const { return m_VerticalFOV; }
 
 	const std::vector<glm::vec3>& GetRayDirections() const { return m_RayDirections; }
+	// Direction through a point in pixel units, GetRayDirections()[x + y * width] is pixel (x, y)
+	glm::vec3 GetRayDirection(const glm::vec2& pixel) const;
+
+	// Changes whenever the view or projection does, unique across cameras. Lets renderers
+	// tell if cached primary rays are stale.
+	uint64_t GetVersion() const { return m_Version; }
 
 	~Camera();
 
@@ -48,6 +60,7 @@ private:
 	glm::vec2 m_LastMousePosition{ 0.0f, 0.0f };
 
 	uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
+	uint64_t m_Version = 0;
 
 };
 
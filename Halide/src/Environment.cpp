@@ -0,0 +1,128 @@
+#include "Environment.h"
+
+#include "ImageIO.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Index of the CDF segment containing u, cdf holds count + 1 ascending entries from 0 to 1
+static uint32_t FindSegment(const float* cdf, uint32_t count, float u)
+{
+	const float* it = std::upper_bound(cdf, cdf + count + 1, u);
+	return (uint32_t)glm::clamp((int)(it - cdf) - 1, 0, (int)count - 1);
+}
+
+EnvironmentMap::EnvironmentMap(uint32_t width, uint32_t height, std::vector<glm::vec3> texels)
+	: m_Width(width), m_Height(height), m_Texels(std::move(texels))
+{
+	// Texel weights include cos(latitude), the solid angle a texel covers
+	std::vector<float> weights((size_t)width * height);
+	double total = 0.0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		float latitude = ((y + 0.5f) / (float)height - 0.5f) * glm::pi<float>();
+		float cosLatitude = std::cos(latitude);
+		for (uint32_t x = 0; x < width; x++)
+		{
+			size_t index = (size_t)y * width + x;
+			weights[index] = std::max(Utils::Luminance(m_Texels[index]), 0.0f) * cosLatitude;
+			total += weights[index];
+		}
+	}
+
+	// A black map still needs a valid distribution
+	if (total <= 0.0)
+	{
+		std::fill(weights.begin(), weights.end(), 1.0f);
+		total = (double)weights.size();
+	}
+
+	m_TexelPdf.resize(weights.size());
+	m_ConditionalCdf.resize((size_t)(width + 1) * height);
+	m_MarginalCdf.resize(height + 1);
+
+	double rowStart = 0.0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		float* conditional = &m_ConditionalCdf[(size_t)y * (width + 1)];
+		double rowSum = 0.0;
+		for (uint32_t x = 0; x < width; x++)
+			rowSum += weights[(size_t)y * width + x];
+
+		double running = 0.0;
+		conditional[0] = 0.0f;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			size_t index = (size_t)y * width + x;
+			running += weights[index];
+			conditional[x + 1] = rowSum > 0.0 ? (float)(running / rowSum) : (float)(x + 1) / (float)width;
+			m_TexelPdf[index] = (float)(weights[index] / total * (double)weights.size());
+		}
+		conditional[width] = 1.0f;
+
+		m_MarginalCdf[y] = (float)(rowStart / total);
+		rowStart += rowSum;
+	}
+	m_MarginalCdf[height] = 1.0f;
+}
+
+std::unique_ptr<EnvironmentMap> EnvironmentMap::LoadPFM(const std::string& path)
+{
+	uint32_t width = 0, height = 0;
+	std::vector<float> rgb;
+	if (!ImageIO::ReadPFM(path, width, height, rgb))
+		return nullptr;
+
+	std::vector<glm::vec3> texels((size_t)width * height);
+	for (size_t i = 0; i < texels.size(); i++)
+		texels[i] = glm::vec3(rgb[i * 3 + 0], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+	return std::make_unique<EnvironmentMap>(width, height, std::move(texels));
+}
+
+uint32_t EnvironmentMap::TexelIndex(const glm::vec2& uv) const
+{
+	uint32_t x = std::min((uint32_t)std::max(uv.x * (float)m_Width, 0.0f), m_Width - 1);
+	uint32_t y = std::min((uint32_t)std::max(uv.y * (float)m_Height, 0.0f), m_Height - 1);
+	return y * m_Width + x;
+}
+
+float EnvironmentMap::PdfFromUV(float uvPdf, float v) const
+{
+	// d(omega) = 2 pi^2 cos(latitude) du dv
+	float cosLatitude = std::cos((v - 0.5f) * glm::pi<float>());
+	if (cosLatitude <= 0.0f)
+		return 0.0f;
+	return uvPdf / (2.0f * glm::pi<float>() * glm::pi<float>() * cosLatitude);
+}
+
+glm::vec3 EnvironmentMap::Sample(const glm::vec2& u, glm::vec3& direction, float& pdf) const
+{
+	uint32_t y = FindSegment(m_MarginalCdf.data(), m_Height, u.y);
+	const float* conditional = &m_ConditionalCdf[(size_t)y * (m_Width + 1)];
+	uint32_t x = FindSegment(conditional, m_Width, u.x);
+
+	// Reuse the position inside the chosen CDF segments for the position inside the texel
+	float rowWidth = m_MarginalCdf[y + 1] - m_MarginalCdf[y];
+	float columnWidth = conditional[x + 1] - conditional[x];
+	float dv = rowWidth > 0.0f ? glm::clamp((u.y - m_MarginalCdf[y]) / rowWidth, 0.0f, 1.0f) : 0.5f;
+	float du = columnWidth > 0.0f ? glm::clamp((u.x - conditional[x]) / columnWidth, 0.0f, 1.0f) : 0.5f;
+	float uu = ((float)x + du) / (float)m_Width;
+	float vv = ((float)y + dv) / (float)m_Height;
+
+	float phi = (uu - 0.5f) * glm::two_pi<float>();
+	float latitude = (vv - 0.5f) * glm::pi<float>();
+	float cosLatitude = std::cos(latitude);
+	direction = glm::vec3(cosLatitude * std::cos(phi), std::sin(latitude), cosLatitude * std::sin(phi));
+
+	size_t index = (size_t)y * m_Width + x;
+	pdf = PdfFromUV(m_TexelPdf[index], vv);
+	return m_Texels[index] * Intensity;
+}
+
+float EnvironmentMap::Pdf(const glm::vec3& direction) const
+{
+	glm::vec2 uv = Utils::SphereUV(direction);
+	return PdfFromUV(m_TexelPdf[TexelIndex(uv)], uv.y);
+}
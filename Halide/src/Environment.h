@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Utils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Equirectangular HDR environment, laid out like Utils::SphereUV: u turns around +Y and
+// row 0 is the bottom pole. Radiance is constant per texel and the sampling distribution
+// follows it exactly: a 2D CDF over luminance * cos(latitude), marginal over rows and
+// conditional within each row, so Evaluate, Sample and Pdf all agree.
+class EnvironmentMap
+{
+public:
+	EnvironmentMap(uint32_t width, uint32_t height, std::vector<glm::vec3> texels);
+
+	// PFM in the same layout, nullptr if it cannot be read
+	static std::unique_ptr<EnvironmentMap> LoadPFM(const std::string& path);
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+
+	// Radiance arriving from a unit direction, a single texel fetch
+	glm::vec3 Evaluate(const glm::vec3& direction) const { return m_Texels[TexelIndex(Utils::SphereUV(direction))] * Intensity; }
+
+	// Direction drawn proportional to the map's luminance, its solid-angle pdf and the radiance from it.
+	// pdf is 0 when the sample is unusable.
+	glm::vec3 Sample(const glm::vec2& u, glm::vec3& direction, float& pdf) const;
+	// Solid-angle pdf of Sample for a unit direction
+	float Pdf(const glm::vec3& direction) const;
+
+	float Intensity = 1.0f;
+
+private:
+	uint32_t TexelIndex(const glm::vec2& uv) const;
+	float PdfFromUV(float uvPdf, float v) const;
+
+private:
+	uint32_t m_Width, m_Height;
+	std::vector<glm::vec3> m_Texels;
+
+	std::vector<float> m_MarginalCdf;    // Height + 1 entries over rows
+	std::vector<float> m_ConditionalCdf; // Width + 1 entries per row
+	std::vector<float> m_TexelPdf;       // Density per unit of uv area
+};
@@ -1,11 +1,25 @@
 #pragma once
 #include <glm/glm.hpp>
 
+// Which of the Scene's primitive arrays a hit belongs to
+enum class PrimitiveType
+{
+	Sphere = 0,
+	Plane,
+	Box,
+	Disc
+};
+
 struct HitPayload
 {
 	float HitDistance;
 	glm::vec3 WorldPosition;
 	glm::vec3 WorldNormal;
+	glm::vec2 UV;              // Texture coordinates, spherical on spheres and planar on flat primitives
+	float UVPerWorldUnit;      // Texture-space scale at the hit, for mip selection
 
-	int ObjectIndex;
-};
\ No newline at end of file
+	PrimitiveType Type = PrimitiveType::Sphere;
+	int ObjectIndex;   // Into the Scene array of Type, or into the SphereSet when InstanceIndex >= 0
+	int InstanceIndex = -1;
+	int MaterialIndex;
+};
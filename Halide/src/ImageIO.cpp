@@ -0,0 +1,86 @@
+#include "ImageIO.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace ImageIO
+{
+	bool ReadPFMHeader(const std::string& path, PFMHeader& header)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		std::string magic;
+		float scale = 0.0f;
+		file >> magic >> header.Width >> header.Height >> scale;
+		file.get();
+		if (!file || (magic != "PF" && magic != "Pf") || header.Width == 0 || header.Height == 0)
+			return false;
+
+		// Positive scale means big-endian data, not worth supporting
+		if (scale >= 0.0f)
+			return false;
+
+		header.Channels = magic == "PF" ? 3 : 1;
+		header.DataOffset = (size_t)file.tellg();
+		return true;
+	}
+
+	bool ReadPFM(const std::string& path, uint32_t& width, uint32_t& height, std::vector<float>& rgb)
+	{
+		PFMHeader header;
+		if (!ReadPFMHeader(path, header))
+			return false;
+
+		std::ifstream file(path, std::ios::binary);
+		file.seekg(header.DataOffset);
+
+		size_t pixelCount = (size_t)header.Width * header.Height;
+		std::vector<float> data(pixelCount * header.Channels);
+		file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+		if (!file)
+			return false;
+
+		width = header.Width;
+		height = header.Height;
+		rgb.resize(pixelCount * 3);
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+				rgb[i * 3 + c] = data[i * header.Channels + (header.Channels == 3 ? c : 0)];
+		}
+		return true;
+	}
+
+	bool WritePFM(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& rgb)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file << "PF\n" << width << " " << height << "\n-1.0\n";
+		file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size() * sizeof(float));
+		return (bool)file;
+	}
+
+	bool WritePPM(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& rgb)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+
+		// PPM rows go top to bottom
+		std::vector<uint8_t> row((size_t)width * 3);
+		for (uint32_t y = height; y-- > 0;)
+		{
+			const float* src = &rgb[(size_t)y * width * 3];
+			for (size_t i = 0; i < row.size(); i++)
+				row[i] = (uint8_t)(std::clamp(src[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+		return (bool)file;
+	}
+}
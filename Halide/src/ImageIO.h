@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Portable float maps (PFM): uncompressed little-endian float rows, stored bottom to top.
+// Binary PPM for 8-bit output that any viewer opens.
+namespace ImageIO
+{
+	struct PFMHeader
+	{
+		uint32_t Width = 0, Height = 0;
+		uint32_t Channels = 0;  // 3 for "PF", 1 for "Pf"
+		size_t DataOffset = 0;  // Byte offset of the first row
+	};
+
+	bool ReadPFMHeader(const std::string& path, PFMHeader& header);
+
+	// RGB floats, row 0 is the bottom row
+	bool ReadPFM(const std::string& path, uint32_t& width, uint32_t& height, std::vector<float>& rgb);
+	bool WritePFM(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& rgb);
+
+	// RGB floats in [0, 1] (clamped), row 0 is the bottom row like in WritePFM
+	bool WritePPM(const std::string& path, uint32_t width, uint32_t height, const std::vector<float>& rgb);
+}
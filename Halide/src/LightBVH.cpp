@@ -0,0 +1,316 @@
+#include "LightBVH.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static constexpr uint64_t NotInTree = ~0ull;
+static constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+static float SafeSqrt(float x) { return std::sqrt(std::max(x, 0.0f)); }
+static float SafeAcos(float x) { return std::acos(glm::clamp(x, -1.0f, 1.0f)); }
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+	if (cosA > cosB)
+		return 1.0f;
+	return cosA * cosB + sinA * sinB;
+}
+
+static float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+	if (cosA > cosB)
+		return 0.0f;
+	return sinA * cosB - cosA * sinB;
+}
+
+DirectionCone DirectionCone::Union(const DirectionCone& a, const DirectionCone& b)
+{
+	float thetaA = SafeAcos(a.CosTheta);
+	float thetaB = SafeAcos(b.CosTheta);
+	float thetaD = SafeAcos(glm::dot(a.Axis, b.Axis));
+
+	// One cone already contains the other
+	if (std::min(thetaD + thetaB, glm::pi<float>()) <= thetaA)
+		return a;
+	if (std::min(thetaD + thetaA, glm::pi<float>()) <= thetaB)
+		return b;
+
+	float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+	if (thetaO >= glm::pi<float>())
+		return EntireSphere();
+
+	// Rotate a's axis towards b's until the cone spans both (Rodrigues' formula)
+	glm::vec3 rotationAxis = glm::cross(a.Axis, b.Axis);
+	if (glm::dot(rotationAxis, rotationAxis) == 0.0f)
+		return EntireSphere();
+	rotationAxis = glm::normalize(rotationAxis);
+
+	float thetaR = thetaO - thetaA;
+	float cosR = std::cos(thetaR), sinR = std::sin(thetaR);
+	glm::vec3 axis = a.Axis * cosR + glm::cross(rotationAxis, a.Axis) * sinR + rotationAxis * glm::dot(rotationAxis, a.Axis) * (1.0f - cosR);
+	return { glm::normalize(axis), std::cos(thetaO) };
+}
+
+LightBounds LightBounds::Union(const LightBounds& a, const LightBounds& b)
+{
+	if (a.Power == 0.0f)
+		return b;
+	if (b.Power == 0.0f)
+		return a;
+
+	LightBounds result;
+	result.Bounds = a.Bounds;
+	result.Bounds.Grow(b.Bounds);
+	result.Power = a.Power + b.Power;
+	result.Orientation = DirectionCone::Union(a.Orientation, b.Orientation);
+	result.CosThetaE = std::min(a.CosThetaE, b.CosThetaE);
+	return result;
+}
+
+float LightBounds::Importance(const glm::vec3& point, const glm::vec3& normal) const
+{
+	glm::vec3 center = Bounds.Center();
+	glm::vec3 halfDiagonal = (Bounds.Max - Bounds.Min) * 0.5f;
+	glm::vec3 toPoint = point - center;
+	float distanceSquared = glm::dot(toPoint, toPoint);
+	float radiusSquared = glm::dot(halfDiagonal, halfDiagonal);
+
+	// Angle the bounds subtend from the point, the whole sphere from inside them
+	float cosThetaB = -1.0f;
+	if (distanceSquared > radiusSquared)
+		cosThetaB = SafeSqrt(1.0f - radiusSquared / distanceSquared);
+	float sinThetaB = SafeSqrt(1.0f - cosThetaB * cosThetaB);
+
+	// Avoids the 1 / d^2 singularity for points close to or inside the bounds
+	distanceSquared = std::max(distanceSquared, radiusSquared);
+	glm::vec3 wi = distanceSquared > 0.0f ? toPoint / std::sqrt(distanceSquared) : glm::vec3(0.0f, 0.0f, 1.0f);
+
+	// Smallest angle between an emitter normal and the direction to the point
+	float cosThetaW = glm::dot(Orientation.Axis, wi);
+	float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+	float sinThetaO = SafeSqrt(1.0f - Orientation.CosTheta * Orientation.CosTheta);
+	float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, Orientation.CosTheta);
+	float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, Orientation.CosTheta);
+	float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaP <= CosThetaE)
+		return 0.0f;
+
+	float importance = Power * cosThetaP / distanceSquared;
+
+	// Smallest incident angle at the receiver, one-sided: lights behind the surface get nothing
+	float cosThetaI = -glm::dot(wi, normal);
+	float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+	importance *= CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	return std::max(importance, 0.0f);
+}
+
+void LightBVH::Build(const std::vector<LightBounds>& lights)
+{
+	Clear();
+	m_BitTrails.assign(lights.size(), NotInTree);
+
+	// Lights that emit nothing are never sampled
+	std::vector<BuildLight> buildLights;
+	buildLights.reserve(lights.size());
+	for (uint32_t i = 0; i < (uint32_t)lights.size(); i++)
+	{
+		if (lights[i].Power > 0.0f)
+			buildLights.push_back({ i, lights[i] });
+	}
+
+	if (buildLights.empty())
+		return;
+
+	m_Nodes.reserve(buildLights.size() * 2 - 1);
+	BuildRecursive(buildLights, 0, (uint32_t)buildLights.size(), 0, 0);
+}
+
+float LightBVH::EvaluateCost(const LightBounds& bounds, const AABB& parent, int axis)
+{
+	// Surface area orientation heuristic: power times the solid angle measure of the
+	// orientation bounds times area, with a regularizer against thin slabs
+	float thetaO = SafeAcos(bounds.Orientation.CosTheta);
+	float thetaE = SafeAcos(bounds.CosThetaE);
+	float thetaW = std::min(thetaO + thetaE, glm::pi<float>());
+	float sinThetaO = SafeSqrt(1.0f - bounds.Orientation.CosTheta * bounds.Orientation.CosTheta);
+	float orientationMeasure = glm::two_pi<float>() * (1.0f - bounds.Orientation.CosTheta) +
+		glm::half_pi<float>() * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + bounds.Orientation.CosTheta);
+
+	glm::vec3 extent = parent.Max - parent.Min;
+	float regularizer = extent[axis] > 0.0f ? std::max(std::max(extent.x, extent.y), extent.z) / extent[axis] : 1.0f;
+	return bounds.Power * orientationMeasure * regularizer * bounds.Bounds.HalfArea();
+}
+
+uint32_t LightBVH::BuildRecursive(std::vector<BuildLight>& lights, uint32_t begin, uint32_t end, uint64_t bitTrail, uint32_t depth)
+{
+	uint32_t nodeIndex = (uint32_t)m_Nodes.size();
+	m_Nodes.emplace_back();
+
+	if (end - begin == 1)
+	{
+		Node& leaf = m_Nodes[nodeIndex];
+		leaf.Bounds = lights[begin].Bounds;
+		leaf.ChildOrLight = lights[begin].Index;
+		leaf.IsLeaf = true;
+		m_BitTrails[lights[begin].Index] = bitTrail;
+		return nodeIndex;
+	}
+
+	LightBounds nodeBounds;
+	AABB centroidBounds;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		nodeBounds = LightBounds::Union(nodeBounds, lights[i].Bounds);
+		centroidBounds.Grow(lights[i].Bounds.Bounds.Center());
+	}
+
+	// Binned SAOH split over all three axes. Past half the bit trail the split falls back to
+	// the median, which bounds the depth of what is left by log2 of the light count.
+	uint32_t mid = (begin + end) / 2;
+	bool split = false;
+	if (depth < MaxDepth / 2)
+	{
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		uint32_t bestBin = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float minCentroid = centroidBounds.Min[axis], maxCentroid = centroidBounds.Max[axis];
+			if (maxCentroid <= minCentroid)
+				continue;
+
+			float scale = (float)BinCount / (maxCentroid - minCentroid);
+			LightBounds bins[BinCount];
+			for (uint32_t i = begin; i < end; i++)
+			{
+				uint32_t bin = std::min((uint32_t)((lights[i].Bounds.Bounds.Center()[axis] - minCentroid) * scale), BinCount - 1);
+				bins[bin] = LightBounds::Union(bins[bin], lights[i].Bounds);
+			}
+
+			for (uint32_t splitBin = 1; splitBin < BinCount; splitBin++)
+			{
+				LightBounds below, above;
+				for (uint32_t b = 0; b < splitBin; b++)
+					below = LightBounds::Union(below, bins[b]);
+				for (uint32_t b = splitBin; b < BinCount; b++)
+					above = LightBounds::Union(above, bins[b]);
+
+				float cost = EvaluateCost(below, nodeBounds.Bounds, axis) + EvaluateCost(above, nodeBounds.Bounds, axis);
+				if (below.Power > 0.0f && above.Power > 0.0f && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = splitBin;
+				}
+			}
+		}
+
+		if (bestAxis >= 0)
+		{
+			float minCentroid = centroidBounds.Min[bestAxis];
+			float scale = (float)BinCount / (centroidBounds.Max[bestAxis] - minCentroid);
+			auto it = std::partition(lights.begin() + begin, lights.begin() + end, [&](const BuildLight& light)
+				{
+					uint32_t bin = std::min((uint32_t)((light.Bounds.Bounds.Center()[bestAxis] - minCentroid) * scale), BinCount - 1);
+					return bin < bestBin;
+				});
+			mid = (uint32_t)(it - lights.begin());
+			split = mid > begin && mid < end;
+		}
+	}
+
+	if (!split)
+	{
+		mid = (begin + end) / 2;
+		int axis = 0;
+		glm::vec3 extent = centroidBounds.Max - centroidBounds.Min;
+		if (extent.y > extent[axis])
+			axis = 1;
+		if (extent.z > extent[axis])
+			axis = 2;
+		std::nth_element(lights.begin() + begin, lights.begin() + mid, lights.begin() + end, [axis](const BuildLight& a, const BuildLight& b)
+			{
+				return a.Bounds.Bounds.Center()[axis] < b.Bounds.Bounds.Center()[axis];
+			});
+	}
+
+	// First child directly follows its parent, the second one's index is stored
+	m_Nodes[nodeIndex].Bounds = nodeBounds;
+	BuildRecursive(lights, begin, mid, bitTrail, depth + 1);
+	uint32_t second = BuildRecursive(lights, mid, end, bitTrail | (1ull << depth), depth + 1);
+	m_Nodes[nodeIndex].ChildOrLight = second;
+	return nodeIndex;
+}
+
+bool LightBVH::Sample(const glm::vec3& point, const glm::vec3& normal, float u, uint32_t& light, float& pmf) const
+{
+	if (m_Nodes.empty())
+		return false;
+
+	uint32_t nodeIndex = 0;
+	pmf = 1.0f;
+	while (true)
+	{
+		const Node& node = m_Nodes[nodeIndex];
+		if (node.IsLeaf)
+		{
+			// Inner nodes already checked their children, only a lone root leaf needs it
+			if (nodeIndex > 0 || node.Bounds.Importance(point, normal) > 0.0f)
+			{
+				light = node.ChildOrLight;
+				return true;
+			}
+			return false;
+		}
+
+		float importance0 = m_Nodes[nodeIndex + 1].Bounds.Importance(point, normal);
+		float importance1 = m_Nodes[node.ChildOrLight].Bounds.Importance(point, normal);
+		if (importance0 == 0.0f && importance1 == 0.0f)
+			return false;
+
+		float p0 = importance0 / (importance0 + importance1);
+		if (u < p0)
+		{
+			nodeIndex = nodeIndex + 1;
+			u = std::min(u / p0, OneMinusEpsilon);
+			pmf *= p0;
+		}
+		else
+		{
+			nodeIndex = node.ChildOrLight;
+			u = std::min((u - p0) / (1.0f - p0), OneMinusEpsilon);
+			pmf *= 1.0f - p0;
+		}
+	}
+}
+
+float LightBVH::Pmf(const glm::vec3& point, const glm::vec3& normal, uint32_t light) const
+{
+	uint64_t bitTrail = m_BitTrails[light];
+	if (bitTrail == NotInTree)
+		return 0.0f;
+
+	uint32_t nodeIndex = 0;
+	float pmf = 1.0f;
+	while (true)
+	{
+		const Node& node = m_Nodes[nodeIndex];
+		if (node.IsLeaf)
+			return pmf;
+
+		float importance0 = m_Nodes[nodeIndex + 1].Bounds.Importance(point, normal);
+		float importance1 = m_Nodes[node.ChildOrLight].Bounds.Importance(point, normal);
+		float total = importance0 + importance1;
+		if (total == 0.0f)
+			return 0.0f;
+
+		bool second = (bitTrail & 1) != 0;
+		pmf *= (second ? importance1 : importance0) / total;
+		nodeIndex = second ? node.ChildOrLight : nodeIndex + 1;
+		bitTrail >>= 1;
+	}
+}
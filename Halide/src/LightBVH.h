@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "BVH.h"
+
+// Cone of directions: every direction within acos(CosTheta) of Axis
+struct DirectionCone
+{
+	glm::vec3 Axis{ 0.0f, 0.0f, 1.0f };
+	float CosTheta = 1.0f;
+
+	static DirectionCone EntireSphere() { return { glm::vec3(0.0f, 0.0f, 1.0f), -1.0f }; }
+	static DirectionCone Union(const DirectionCone& a, const DirectionCone& b);
+};
+
+// Conservative description of one or many emitters: where they are, how much they emit
+// and in which directions. Normals lie within Orientation, and light leaves the surface
+// within acos(CosThetaE) of its normal (pi / 2 for diffuse emitters).
+struct LightBounds
+{
+	AABB Bounds;
+	float Power = 0.0f;
+	DirectionCone Orientation;
+	float CosThetaE = 0.0f;
+
+	// Upper bound on the light reaching a point with normal n, relative between siblings only
+	float Importance(const glm::vec3& point, const glm::vec3& normal) const;
+
+	static LightBounds Union(const LightBounds& a, const LightBounds& b);
+};
+
+// Light BVH (Conty & Kulla 2017, as in pbrt-v4): a binary tree over LightBounds split by
+// power, area and orientation. Sampling walks down once, picking each child in proportion
+// to its importance for the shading point, so choosing a light costs O(log n) instead of
+// a linear scan, while still preferring close, bright, well-oriented lights.
+class LightBVH
+{
+public:
+	void Build(const std::vector<LightBounds>& lights);
+	void Clear() { m_Nodes.clear(); m_BitTrails.clear(); }
+
+	bool Empty() const { return m_Nodes.empty(); }
+	size_t GetLightCount() const { return m_BitTrails.size(); }
+
+	// Light index and its selection probability, false when no light can reach the point
+	bool Sample(const glm::vec3& point, const glm::vec3& normal, float u, uint32_t& light, float& pmf) const;
+	// Probability that Sample picks light at this point
+	float Pmf(const glm::vec3& point, const glm::vec3& normal, uint32_t light) const;
+
+private:
+	struct Node
+	{
+		LightBounds Bounds;
+		uint32_t ChildOrLight = 0; // Second child for inner nodes (the first follows the parent), light for leaves
+		bool IsLeaf = false;
+	};
+
+	struct BuildLight
+	{
+		uint32_t Index;
+		LightBounds Bounds;
+	};
+
+	uint32_t BuildRecursive(std::vector<BuildLight>& lights, uint32_t begin, uint32_t end, uint64_t bitTrail, uint32_t depth);
+	static float EvaluateCost(const LightBounds& bounds, const AABB& parent, int axis);
+
+	static constexpr uint32_t BinCount = 12;
+	static constexpr uint32_t MaxDepth = 64; // Bit trails are 64 bits
+
+private:
+	std::vector<Node> m_Nodes;
+	std::vector<uint64_t> m_BitTrails; // Path from the root per light, bit set = second child
+};
@@ -0,0 +1,296 @@
+#include "PathGuiding.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+static constexpr uint32_t NoNode = ~0u;
+
+// Cylindrical coordinates: cos theta against +Z in x, phi in y, both in [0, 1)
+static glm::vec2 ToSquare(const glm::vec3& direction)
+{
+	float phi = std::atan2(direction.y, direction.x) * glm::one_over_two_pi<float>();
+	if (phi < 0.0f)
+		phi += 1.0f;
+	return glm::clamp(glm::vec2((direction.z + 1.0f) * 0.5f, phi), glm::vec2(0.0f), glm::vec2(OneMinusEpsilon));
+}
+
+static glm::vec3 FromSquare(const glm::vec2& p)
+{
+	float cosTheta = 2.0f * p.x - 1.0f;
+	float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+	float phi = glm::two_pi<float>() * p.y;
+	return glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+DirectionalTree::DirectionalTree()
+{
+	m_Nodes.emplace_back();
+}
+
+uint32_t DirectionalTree::Quadrant(glm::vec2& p)
+{
+	uint32_t x = p.x >= 0.5f ? 1 : 0;
+	uint32_t y = p.y >= 0.5f ? 1 : 0;
+	p = glm::min(p * 2.0f - glm::vec2((float)x, (float)y), glm::vec2(OneMinusEpsilon));
+	return x + 2 * y;
+}
+
+void DirectionalTree::Record(const glm::vec3& direction, float value)
+{
+	if (!(value > 0.0f) || !std::isfinite(value))
+		return;
+
+	// Only leaf quadrants are written, Refined sums them up the tree
+	glm::vec2 p = ToSquare(direction);
+	uint32_t node = 0;
+	while (true)
+	{
+		uint32_t quadrant = Quadrant(p);
+		uint32_t child = m_Nodes[node].Children[quadrant];
+		if (child == 0)
+		{
+			m_Nodes[node].Sum[quadrant].Add(value);
+			return;
+		}
+		node = child;
+	}
+}
+
+glm::vec3 DirectionalTree::Sample(glm::vec2 u) const
+{
+	glm::vec2 origin(0.0f);
+	float size = 1.0f;
+	uint32_t node = 0;
+	while (true)
+	{
+		const Node& current = m_Nodes[node];
+		float sum[4] = { current.Sum[0].Load(), current.Sum[1].Load(), current.Sum[2].Load(), current.Sum[3].Load() };
+
+		// Column first, then the quadrant within it, rescaling u to stay uniform
+		float left = sum[0] + sum[2], right = sum[1] + sum[3];
+		float pLeft = left / std::max(left + right, 1e-30f);
+		uint32_t x = u.x < pLeft ? 0 : 1;
+		u.x = x == 0 ? u.x / pLeft : (u.x - pLeft) / (1.0f - pLeft);
+
+		float pBottom = sum[x] / std::max(sum[x] + sum[x + 2], 1e-30f);
+		uint32_t y = u.y < pBottom ? 0 : 1;
+		u.y = y == 0 ? u.y / pBottom : (u.y - pBottom) / (1.0f - pBottom);
+		u = glm::clamp(u, glm::vec2(0.0f), glm::vec2(OneMinusEpsilon));
+
+		size *= 0.5f;
+		origin += glm::vec2((float)x, (float)y) * size;
+		uint32_t child = current.Children[x + 2 * y];
+		if (child == 0)
+			return FromSquare(origin + u * size);
+		node = child;
+	}
+}
+
+float DirectionalTree::Pdf(const glm::vec3& direction) const
+{
+	glm::vec2 p = ToSquare(direction);
+	float pdf = 1.0f;
+	uint32_t node = 0;
+	while (true)
+	{
+		const Node& current = m_Nodes[node];
+		float total = current.Sum[0].Load() + current.Sum[1].Load() + current.Sum[2].Load() + current.Sum[3].Load();
+		if (total <= 0.0f)
+			return 0.0f;
+
+		uint32_t quadrant = Quadrant(p);
+		pdf *= 4.0f * current.Sum[quadrant].Load() / total;
+		node = current.Children[quadrant];
+		if (node == 0)
+			return pdf * glm::one_over_pi<float>() * 0.25f;
+	}
+}
+
+float DirectionalTree::GetTotal() const
+{
+	const Node& root = m_Nodes[0];
+	return root.Sum[0].Load() + root.Sum[1].Load() + root.Sum[2].Load() + root.Sum[3].Load();
+}
+
+float DirectionalTree::AccumulateTotals(uint32_t node)
+{
+	float total = 0.0f;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		uint32_t child = m_Nodes[node].Children[i];
+		if (child != 0)
+			m_Nodes[node].Sum[i].Store(AccumulateTotals(child));
+		total += m_Nodes[node].Sum[i].Load();
+	}
+	return total;
+}
+
+DirectionalTree DirectionalTree::Refined(float threshold) const
+{
+	DirectionalTree source = *this;
+	float total = source.AccumulateTotals(0);
+
+	DirectionalTree result;
+	if (total <= 0.0f)
+		return result;
+
+	const Node& root = source.m_Nodes[0];
+	float energy[4] = { root.Sum[0].Load(), root.Sum[1].Load(), root.Sum[2].Load(), root.Sum[3].Load() };
+	source.BuildRefined(result, 0, 0, energy, total, threshold, 1);
+	return result;
+}
+
+void DirectionalTree::BuildRefined(DirectionalTree& target, uint32_t targetNode, uint32_t sourceNode, const float energy[4], float total, float threshold, uint32_t depth) const
+{
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		target.m_Nodes[targetNode].Sum[i].Store(energy[i]);
+		if (depth >= MaxDepth || energy[i] <= threshold * total)
+			continue;
+
+		// Quadrants the source never subdivided are split evenly, the next pass refines them
+		uint32_t sourceChild = sourceNode != NoNode && m_Nodes[sourceNode].Children[i] != 0 ? m_Nodes[sourceNode].Children[i] : NoNode;
+		float childEnergy[4];
+		for (uint32_t c = 0; c < 4; c++)
+			childEnergy[c] = sourceChild != NoNode ? m_Nodes[sourceChild].Sum[c].Load() : energy[i] * 0.25f;
+
+		uint32_t child = (uint32_t)target.m_Nodes.size();
+		target.m_Nodes.emplace_back();
+		target.m_Nodes[targetNode].Children[i] = child;
+		BuildRefined(target, child, sourceChild, childEnergy, total, threshold, depth + 1);
+	}
+}
+
+void DirectionalTree::Clear()
+{
+	for (Node& node : m_Nodes)
+	{
+		for (AtomicFloat& sum : node.Sum)
+			sum.Store(0.0f);
+	}
+}
+
+GuidingField::GuidingField(const AABB& bounds, size_t memoryBudget)
+	: m_MemoryBudget(memoryBudget)
+{
+	// Cubic bounds, so splits cycling through the axes keep cells roughly cubic
+	glm::vec3 center = bounds.Center();
+	glm::vec3 extent = bounds.Max - bounds.Min;
+	float halfSize = std::max(std::max(std::max(extent.x, extent.y), extent.z) * 0.5f, 1e-3f) * 1.01f;
+	m_Bounds.Min = center - glm::vec3(halfSize);
+	m_Bounds.Max = center + glm::vec3(halfSize);
+
+	m_Nodes.emplace_back();
+	m_Leaves.emplace_back();
+	m_MemoryUsage = sizeof(SpatialNode) + LeafMemory(m_Leaves[0]);
+}
+
+uint32_t GuidingField::FindRegion(const glm::vec3& point) const
+{
+	// Infinite planes reach outside the bounds, their points clamp to the boundary cells
+	glm::vec3 p = glm::clamp((point - m_Bounds.Min) / (m_Bounds.Max - m_Bounds.Min), glm::vec3(0.0f), glm::vec3(OneMinusEpsilon));
+	uint32_t node = 0;
+	while (m_Nodes[node].Children[0] != 0)
+	{
+		uint32_t axis = m_Nodes[node].Axis;
+		uint32_t side = p[axis] < 0.5f ? 0 : 1;
+		p[axis] = std::min(p[axis] * 2.0f - (float)side, OneMinusEpsilon);
+		node = m_Nodes[node].Children[side];
+	}
+	return m_Nodes[node].Leaf;
+}
+
+const DirectionalTree* GuidingField::GetDistribution(uint32_t region) const
+{
+	const DirectionalTree& tree = m_Leaves[region].Sampling;
+	return tree.GetTotal() > 0.0f ? &tree : nullptr;
+}
+
+void GuidingField::Record(uint32_t region, const glm::vec3& direction, float value)
+{
+	Leaf& leaf = m_Leaves[region];
+	leaf.SampleCount.fetch_add(1, std::memory_order_relaxed);
+	leaf.Training.Record(direction, value);
+}
+
+void GuidingField::EndFrame()
+{
+	if (++m_FramesInPass < (1u << std::min(m_Iteration, 16u)))
+		return;
+
+	Refine();
+	m_Iteration++;
+	m_FramesInPass = 0;
+}
+
+size_t GuidingField::LeafMemory(const Leaf& leaf)
+{
+	return sizeof(Leaf) + leaf.Sampling.GetMemoryUsage() + leaf.Training.GetMemoryUsage();
+}
+
+void GuidingField::SplitLeaf(uint32_t node, uint32_t samples, uint32_t threshold)
+{
+	if (samples <= threshold || m_MemoryUsage > m_MemoryBudget)
+		return;
+
+	// Both halves start from the parent's training data, assuming samples split evenly
+	uint32_t leaf = m_Nodes[node].Leaf;
+	Leaf copy = m_Leaves[leaf];
+	m_Leaves.push_back(copy);
+	m_MemoryUsage += LeafMemory(copy) + 2 * sizeof(SpatialNode);
+
+	uint32_t axis = (m_Nodes[node].Axis + 1) % 3;
+	for (uint32_t side = 0; side < 2; side++)
+	{
+		SpatialNode child;
+		child.Axis = axis;
+		child.Leaf = side == 0 ? leaf : (uint32_t)m_Leaves.size() - 1;
+		m_Nodes[node].Children[side] = (uint32_t)m_Nodes.size();
+		m_Nodes.push_back(child);
+	}
+
+	SplitLeaf(m_Nodes[node].Children[0], samples / 2, threshold);
+	SplitLeaf(m_Nodes[node].Children[1], samples / 2, threshold);
+}
+
+void GuidingField::Refine()
+{
+	uint32_t passFrames = 1u << std::min(m_Iteration, 16u);
+	uint32_t threshold = (uint32_t)(SpatialThreshold * std::sqrt((float)passFrames));
+
+	uint32_t nodeCount = (uint32_t)m_Nodes.size();
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		if (m_Nodes[node].Children[0] == 0)
+			SplitLeaf(node, m_Leaves[m_Nodes[node].Leaf].SampleCount.load(), threshold);
+	}
+
+	// Directional trees for the next pass, coarser until both copies fit the budget
+	std::vector<DirectionalTree> refined(m_Leaves.size());
+	float directionalThreshold = DirectionalThreshold;
+	size_t usage = 0;
+	while (true)
+	{
+		usage = m_Nodes.size() * sizeof(SpatialNode) + m_Leaves.size() * sizeof(Leaf);
+		for (size_t i = 0; i < m_Leaves.size(); i++)
+		{
+			refined[i] = m_Leaves[i].Training.Refined(directionalThreshold);
+			usage += 2 * refined[i].GetMemoryUsage();
+		}
+		if (usage <= m_MemoryBudget || directionalThreshold >= 1.0f)
+			break;
+		directionalThreshold *= 2.0f;
+	}
+
+	for (size_t i = 0; i < m_Leaves.size(); i++)
+	{
+		m_Leaves[i].Sampling = refined[i];
+		m_Leaves[i].Training = std::move(refined[i]);
+		m_Leaves[i].Training.Clear();
+		m_Leaves[i].SampleCount.store(0);
+	}
+	m_MemoryUsage = usage;
+}
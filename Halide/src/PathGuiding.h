@@ -0,0 +1,136 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "BVH.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Float that many threads can add to, copies take a relaxed snapshot
+class AtomicFloat
+{
+public:
+	AtomicFloat(float value = 0.0f) : m_Value(value) {}
+	AtomicFloat(const AtomicFloat& other) : m_Value(other.Load()) {}
+	AtomicFloat& operator=(const AtomicFloat& other) { m_Value.store(other.Load(), std::memory_order_relaxed); return *this; }
+
+	float Load() const { return m_Value.load(std::memory_order_relaxed); }
+	void Store(float value) { m_Value.store(value, std::memory_order_relaxed); }
+	void Add(float value)
+	{
+		float current = m_Value.load(std::memory_order_relaxed);
+		while (!m_Value.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+			;
+	}
+
+private:
+	std::atomic<float> m_Value;
+};
+
+// Distribution over directions as a quadtree on the square of cylindrical coordinates
+// (cos theta, phi), which preserves area: solid-angle pdf = square pdf / 4 pi. Every node
+// holds the energy of its four quadrants, a quadrant without a child is uniform.
+class DirectionalTree
+{
+public:
+	DirectionalTree();
+
+	// Adds to the quadrant leaf containing direction, safe to call from many threads
+	void Record(const glm::vec3& direction, float value);
+
+	// Direction drawn proportional to the recorded energy, only valid when GetTotal() > 0
+	glm::vec3 Sample(glm::vec2 u) const;
+	float Pdf(const glm::vec3& direction) const;
+
+	float GetTotal() const;
+	size_t GetMemoryUsage() const { return m_Nodes.size() * sizeof(Node); }
+
+	// Distribution for the next pass from the energy recorded in this one: quadrants holding
+	// more than threshold of the total get subdivided, up to MaxDepth levels
+	DirectionalTree Refined(float threshold) const;
+	// Same topology, zero energy
+	void Clear();
+
+	static constexpr uint32_t MaxDepth = 20;
+
+private:
+	struct Node
+	{
+		AtomicFloat Sum[4];
+		uint32_t Children[4] = { 0, 0, 0, 0 }; // 0 for a leaf quadrant, the root is never a child
+	};
+
+	// Quadrants are numbered x + 2y in their node
+	static uint32_t Quadrant(glm::vec2& p);
+	float AccumulateTotals(uint32_t node);
+	void BuildRefined(DirectionalTree& target, uint32_t targetNode, uint32_t sourceNode, const float energy[4], float total, float threshold, uint32_t depth) const;
+
+private:
+	std::vector<Node> m_Nodes;
+};
+
+// Spatial kd-tree over the scene bounds with a directional distribution per leaf: the
+// SD-tree of Mueller et al. 2017 ("Practical Path Guiding"). Training runs in passes of
+// doubling length. During a pass paths sample the distributions learned by the previous
+// passes and record incident radiance into a second copy; EndFrame refines both trees
+// between passes. Region lookups and Record are thread-safe within a frame, EndFrame is not.
+class GuidingField
+{
+public:
+	GuidingField(const AABB& bounds, size_t memoryBudget);
+
+	// Leaf cell containing a point, points outside the bounds use the nearest cell.
+	// Regions stay valid until the next EndFrame.
+	uint32_t FindRegion(const glm::vec3& point) const;
+	// Learned distribution of a region, nullptr until it has recorded something
+	const DirectionalTree* GetDistribution(uint32_t region) const;
+	// Incident radiance estimate divided by the pdf of the direction it arrived from
+	void Record(uint32_t region, const glm::vec3& direction, float value);
+
+	// Call after every rendered frame, refines at the end of each pass
+	void EndFrame();
+
+	uint32_t GetIteration() const { return m_Iteration; }
+	size_t GetMemoryUsage() const { return m_MemoryUsage; }
+	size_t GetMemoryBudget() const { return m_MemoryBudget; }
+
+	// Leaves split when a pass records more than this times sqrt(frames in the pass) samples
+	static constexpr float SpatialThreshold = 12000.0f;
+	// Share of a directional tree's energy above which a quadrant is subdivided
+	static constexpr float DirectionalThreshold = 0.01f;
+
+private:
+	struct SpatialNode
+	{
+		uint32_t Children[2] = { 0, 0 }; // 0 for leaves, children split at the midpoint of Axis
+		uint32_t Axis = 0;
+		uint32_t Leaf = 0;
+	};
+
+	struct Leaf
+	{
+		DirectionalTree Sampling;
+		DirectionalTree Training;
+		std::atomic<uint32_t> SampleCount{ 0 };
+
+		Leaf() = default;
+		Leaf(const Leaf& other) : Sampling(other.Sampling), Training(other.Training), SampleCount(other.SampleCount.load()) {}
+	};
+
+	static size_t LeafMemory(const Leaf& leaf);
+	void Refine();
+	void SplitLeaf(uint32_t node, uint32_t samples, uint32_t threshold);
+
+private:
+	AABB m_Bounds;
+	size_t m_MemoryBudget;
+	size_t m_MemoryUsage = 0; // Kept up to date by SplitLeaf and Refine
+
+	std::vector<SpatialNode> m_Nodes;
+	std::vector<Leaf> m_Leaves;
+
+	uint32_t m_Iteration = 0;
+	uint32_t m_FramesInPass = 0;
+};
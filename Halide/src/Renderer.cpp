@@ -1,29 +1,39 @@
 #include "Renderer.h"
 
-#include "Walnut/Random.h"
+#include <glm/gtc/constants.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <execution>
+#include <type_traits>
 
 
 void Renderer::OnResize(uint32_t width, uint32_t height)
 {
-	if (m_FinalImage) {
+	// No resize necessary
+	if (m_ImageData && m_Width == width && m_Height == height)
+		return;
 
-		// No resize necessary
-		if (m_FinalImage->GetWidth() == width && m_FinalImage->GetHeight() == height)
-			return;
+	m_Width = width;
+	m_Height = height;
+
+#ifndef HALIDE_HEADLESS
+	if (m_FinalImage)
 		m_FinalImage->Resize(width, height);
-	}
 	else
-	{
 		m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
-	}
+#endif
 
 	delete[] m_ImageData;//Does the check for m_ImageData
 	m_ImageData = new uint32_t[width * height];
 
 	delete[] m_AccumulationData;
 	m_AccumulationData = new glm::vec4[width * height];
+	m_FrameIndex = 1;
+
+	m_AlbedoData = {};
+	m_NormalData = {};
+	m_DepthData = {};
 
 	m_ImageHorizontalIterator.resize(width);
 	m_ImageVerticalIterator.resize(height);
@@ -38,11 +48,305 @@ void Renderer::Render(const Scene& scene, const Camera& camera)
 	m_ActiveCamera = &camera;
 	m_ActiveScene = &scene;
 
+	if (!m_Sampler || m_SamplerType != m_Settings.Sampler)
+	{
+		m_Sampler = Sampler::Create(m_Settings.Sampler);
+		m_SamplerType = m_Settings.Sampler;
+	}
+
 	if (m_FrameIndex == 1)
-		memset(m_AccumulationData, 0, m_FinalImage->GetWidth() * m_FinalImage->GetHeight() * sizeof(glm::vec4));
+		memset(m_AccumulationData, 0, m_Width * m_Height * sizeof(glm::vec4));
 
+	m_PixelSpreadAngle = 2.0f * std::tan(glm::radians(camera.GetVerticalFOV()) * 0.5f) / (float)m_Height;
+	PrepareFirstHits();
+	PrepareLights();
+	PrepareGuiding();
+	PrepareAOVs();
 
-	
+	uint32_t required = m_Settings.SpecializeKernels ? GetSceneFeatures(scene, m_Settings) : (uint32_t)KernelFeature::AllContent;
+	if (m_Settings.Gamma)
+		required |= KernelFeature::Gamma;
+	if (m_Settings.Accumulate)
+		required |= KernelFeature::Accumulate;
+	if (m_Guiding)
+		required |= KernelFeature::Guiding;
+	if (m_Settings.OutputAOVs)
+		required |= KernelFeature::AOVs;
+
+	KernelFn kernel = SelectKernel(required, m_ActiveKernel);
+	(this->*kernel)();
+
+	if (m_FirstHitMode == FirstHitMode::Record)
+		m_FirstHitLayerValid[m_SubpixelIndex] = 1;
+	if (m_Guiding)
+		m_Guiding->EndFrame();
+
+#ifndef HALIDE_HEADLESS
+	m_FinalImage->SetData(m_ImageData);
+#endif
+
+	if (m_Settings.Accumulate)
+		m_FrameIndex++;
+	else
+		m_FrameIndex = 1;
+}
+
+void Renderer::PrepareFirstHits()
+{
+	int positions = m_Settings.JitterAA ? glm::clamp(m_Settings.SubpixelPositions, 1, MaxSubpixelPositions) : 0;
+	uint32_t layers = (uint32_t)std::max(positions, 1);
+	m_SubpixelIndex = (m_FrameIndex - 1 + m_Settings.SampleIndexOffset) % layers;
+
+	if (!m_Settings.CacheFirstHits)
+	{
+		m_FirstHitMode = FirstHitMode::Off;
+		m_FirstHits = {};
+		m_FirstHitLayerValid.clear();
+		m_FirstHitKey = {};
+		return;
+	}
+
+	// Camera and scene versions change on every edit, so any movement drops the cache
+	FirstHitKey key;
+	key.SceneVersion = m_ActiveScene->Version;
+	key.CameraVersion = m_ActiveCamera->GetVersion();
+	key.Width = m_Width;
+	key.Height = m_Height;
+	key.Positions = positions;
+	if (!(key == m_FirstHitKey))
+	{
+		m_FirstHitKey = key;
+		m_FirstHits.resize((size_t)layers * m_Width * m_Height);
+		m_FirstHitLayerValid.assign(layers, 0);
+	}
+
+	m_FirstHitMode = m_FirstHitLayerValid[m_SubpixelIndex] ? FirstHitMode::Replay : FirstHitMode::Record;
+}
+
+void Renderer::PrepareLights()
+{
+	const Scene& scene = *m_ActiveScene;
+	if (m_LightsVersion == scene.Version && m_SphereLights.size() == scene.Spheres.size())
+		return;
+	m_LightsVersion = scene.Version;
+
+	// Emissive spheres radiate uniformly in every direction: power is pi * area * radiance
+	std::vector<LightBounds> lights;
+	m_LightSpheres.clear();
+	m_SphereLights.assign(scene.Spheres.size(), -1);
+	for (size_t i = 0; i < scene.Spheres.size(); i++)
+	{
+		const Sphere* sphere = scene.Spheres[i];
+		const Material* material = scene.Materials[sphere->MaterialIndex];
+		if (material->matType != materialType::EmissiveMat)
+			continue;
+		float luminance = Utils::Luminance(static_cast<const Emissive*>(material)->GetEmission());
+		if (luminance <= 0.0f)
+			continue;
+
+		LightBounds light;
+		light.Bounds.Grow(sphere->Position - glm::vec3(sphere->Radius));
+		light.Bounds.Grow(sphere->Position + glm::vec3(sphere->Radius));
+		light.Power = glm::pi<float>() * 4.0f * glm::pi<float>() * sphere->Radius * sphere->Radius * luminance;
+		light.Orientation = DirectionCone::EntireSphere();
+		light.CosThetaE = 0.0f;
+
+		m_SphereLights[i] = (int)m_LightSpheres.size();
+		m_LightSpheres.push_back((uint32_t)i);
+		lights.push_back(light);
+	}
+	m_LightTree.Build(lights);
+}
+
+void Renderer::PrepareAOVs()
+{
+	if (!m_Settings.OutputAOVs)
+	{
+		m_AlbedoData = {};
+		m_NormalData = {};
+		m_DepthData = {};
+		return;
+	}
+
+	size_t pixels = (size_t)m_Width * m_Height;
+	if (m_FrameIndex == 1 || m_DepthData.size() != pixels)
+	{
+		m_AlbedoData.assign(pixels, glm::vec3(0.0f));
+		m_NormalData.assign(pixels, glm::vec3(0.0f));
+		m_DepthData.assign(pixels, 0.0f);
+	}
+}
+
+// Finite geometry only, points on infinite planes are clamped into these bounds
+static AABB GuidingBounds(const Scene& scene)
+{
+	AABB bounds;
+	for (const Sphere* sphere : scene.Spheres)
+	{
+		bounds.Grow(sphere->Position - glm::vec3(sphere->Radius));
+		bounds.Grow(sphere->Position + glm::vec3(sphere->Radius));
+	}
+	for (const Box& box : scene.Boxes)
+	{
+		bounds.Grow(box.Min);
+		bounds.Grow(box.Max);
+	}
+	for (const Disc& disc : scene.Discs)
+	{
+		bounds.Grow(disc.Center - glm::vec3(disc.Radius));
+		bounds.Grow(disc.Center + glm::vec3(disc.Radius));
+	}
+	if (!scene.InstanceAccel.Empty())
+		bounds.Grow(scene.InstanceAccel.GetBounds());
+	if (!bounds.Valid())
+		bounds.Grow(glm::vec3(0.0f));
+	return bounds;
+}
+
+void Renderer::PrepareGuiding()
+{
+	if (!m_Settings.PathGuiding)
+	{
+		m_Guiding.reset();
+		return;
+	}
+
+	// Radiance does not depend on the camera, only scene edits and a new budget start over
+	if (m_Guiding && m_GuidingVersion == m_ActiveScene->Version && m_Guiding->GetMemoryBudget() == m_Settings.GuidingMemoryBudget)
+		return;
+	m_GuidingVersion = m_ActiveScene->Version;
+	m_Guiding = std::make_unique<GuidingField>(GuidingBounds(*m_ActiveScene), m_Settings.GuidingMemoryBudget);
+}
+
+Ray Renderer::GeneratePrimaryRay(uint32_t x, uint32_t y) const
+{
+	Ray ray;
+	ray.Origin = m_ActiveCamera->GetPosition();
+	if (!m_Settings.JitterAA)
+	{
+		ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_Width];
+		return ray;
+	}
+
+	// R2 points with a per-pixel rotation, the same positions every time a layer is traced
+	uint32_t hash = Utils::PCG_Hash(x + y * m_Width);
+	glm::vec2 rotation((float)hash / 4294967296.0f, (float)Utils::PCG_Hash(hash) / 4294967296.0f);
+	glm::vec2 offset = glm::fract(rotation + (float)m_SubpixelIndex * glm::vec2(0.75487766f, 0.56984029f));
+	ray.Direction = m_ActiveCamera->GetRayDirection(glm::vec2((float)x, (float)y) + offset);
+	return ray;
+}
+
+uint32_t Renderer::GetSceneFeatures(const Scene& scene, const Settings& settings)
+{
+	uint32_t features = 0;
+	for (const Material* material : scene.Materials)
+	{
+		switch (material->matType)
+		{
+		case materialType::DiffuseMat:    features |= KernelFeature::Diffuse; break;
+		case materialType::MetalMat:      features |= KernelFeature::Metal; break;
+		case materialType::DialectricMat: features |= KernelFeature::Dialectric; break;
+		case materialType::EmissiveMat:   features |= KernelFeature::Emissive; break;
+		default:                          features |= KernelFeature::AllContent; break;
+		}
+		if (material->AlbedoTexture >= 0)
+			features |= KernelFeature::Textures;
+	}
+	if (scene.Environment)
+		features |= KernelFeature::Environment;
+	if ((settings.DistantLights && !scene.Lights.empty()) || (features & KernelFeature::Emissive))
+		features |= KernelFeature::Lights;
+	if (!scene.Instances.empty())
+		features |= KernelFeature::Instances;
+	return features;
+}
+
+std::string Renderer::GetKernelName(uint32_t features)
+{
+	std::string name;
+	auto append = [&](uint32_t bit, const char* label)
+	{
+		if (!(features & bit))
+			return;
+		if (!name.empty())
+			name += "+";
+		name += label;
+	};
+	append(KernelFeature::Diffuse, "diffuse");
+	append(KernelFeature::Metal, "metal");
+	append(KernelFeature::Dialectric, "dialectric");
+	append(KernelFeature::Emissive, "emissive");
+	append(KernelFeature::Instances, "instances");
+	append(KernelFeature::Textures, "textures");
+	append(KernelFeature::Environment, "environment");
+	append(KernelFeature::Lights, "lights");
+	append(KernelFeature::Guiding, "guiding");
+	append(KernelFeature::AOVs, "aovs");
+	name += (features & KernelFeature::Gamma) ? ", gamma" : ", linear";
+	name += (features & KernelFeature::Accumulate) ? ", accumulate" : ", single frame";
+	return name;
+}
+
+// Content sets that get their own kernels, smallest first. Each one is instantiated for
+// all four Gamma/Accumulate combinations, and with guiding and AOVs for the two that accumulate;
+// scenes use the first set that covers them. Sets with lights follow their lights-free twin,
+// unlit scenes keep the smaller kernel.
+static constexpr uint32_t s_KernelContents[] = {
+	KernelFeature::Diffuse | KernelFeature::Metal,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Lights,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Instances,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Instances | KernelFeature::Lights,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Instances | KernelFeature::Textures,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Instances | KernelFeature::Textures | KernelFeature::Lights,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Environment,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Environment | KernelFeature::Lights,
+	KernelFeature::Diffuse | KernelFeature::Metal | KernelFeature::Emissive | KernelFeature::Environment | KernelFeature::Lights,
+	KernelFeature::AllContent,
+};
+
+Renderer::KernelFn Renderer::SelectKernel(uint32_t requiredFeatures, uint32_t& kernelFeatures)
+{
+#define HALIDE_KERNELS(content) \
+		{ content, &Renderer::RenderFrame<content> }, \
+		{ content | KernelFeature::Gamma, &Renderer::RenderFrame<content | KernelFeature::Gamma> }, \
+		{ content | KernelFeature::Accumulate, &Renderer::RenderFrame<content | KernelFeature::Accumulate> }, \
+		{ content | KernelFeature::Settings, &Renderer::RenderFrame<content | KernelFeature::Settings> }, \
+		{ content | KernelFeature::Extras | KernelFeature::Accumulate, &Renderer::RenderFrame<content | KernelFeature::Extras | KernelFeature::Accumulate> }, \
+		{ content | KernelFeature::Extras | KernelFeature::Settings, &Renderer::RenderFrame<content | KernelFeature::Extras | KernelFeature::Settings> }
+
+	static const struct { uint32_t Features; KernelFn Kernel; } kernels[] = {
+		HALIDE_KERNELS(s_KernelContents[0]),
+		HALIDE_KERNELS(s_KernelContents[1]),
+		HALIDE_KERNELS(s_KernelContents[2]),
+		HALIDE_KERNELS(s_KernelContents[3]),
+		HALIDE_KERNELS(s_KernelContents[4]),
+		HALIDE_KERNELS(s_KernelContents[5]),
+		HALIDE_KERNELS(s_KernelContents[6]),
+		HALIDE_KERNELS(s_KernelContents[7]),
+		HALIDE_KERNELS(s_KernelContents[8]),
+		HALIDE_KERNELS(s_KernelContents[9]),
+	};
+#undef HALIDE_KERNELS
+
+	for (const auto& entry : kernels)
+	{
+		bool settingsMatch = (entry.Features & KernelFeature::Settings) == (requiredFeatures & KernelFeature::Settings);
+		bool coversContent = (entry.Features & requiredFeatures) == requiredFeatures;
+		if (settingsMatch && coversContent)
+		{
+			kernelFeatures = entry.Features;
+			return entry.Kernel;
+		}
+	}
+
+	// Unreachable, the last content set covers everything in all four settings combinations
+	kernelFeatures = KernelFeature::AllContent | KernelFeature::Settings;
+	return &Renderer::RenderFrame<KernelFeature::AllContent | KernelFeature::Settings>;
+}
+
+template<uint32_t Features>
+void Renderer::RenderFrame()
+{
 	// Try implementing threadpool
 
 	// ~2m -> 1920x1080
@@ -52,88 +356,493 @@ void Renderer::Render(const Scene& scene, const Camera& camera)
 			std::for_each(std::execution::par, m_ImageHorizontalIterator.begin(), m_ImageHorizontalIterator.end(),
 			[this, y](uint32_t x)
 				{
-					glm::vec4 color = PerPixel(x, y);
-					m_AccumulationData[x + y * m_FinalImage->GetWidth()] += color;
+					glm::vec4 color = PerPixel<Features>(x, y);
+
+					glm::vec4 accumulatedColor;
+					if constexpr ((Features & KernelFeature::Accumulate) != 0)
+					{
+						m_AccumulationData[x + y * m_Width] += color;
 
-					glm::vec4 accumulatedColor = m_AccumulationData[x + y * m_FinalImage->GetWidth()];
-					accumulatedColor /= (float)m_FrameIndex;
+						accumulatedColor = m_AccumulationData[x + y * m_Width];
+						accumulatedColor /= (float)m_FrameIndex;
+					}
+					else
+					{
+						m_AccumulationData[x + y * m_Width] = color;
+						accumulatedColor = color;
+					}
 
 					accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
-					m_ImageData[x + y * m_FinalImage->GetWidth()] = Utils::ConvertToRGBA(accumulatedColor);
+					m_ImageData[x + y * m_Width] = Utils::ConvertToRGBA(accumulatedColor);
+
+					if constexpr ((Features & KernelFeature::Textures) != 0)
+						TextureCache::FlushThreadState();
 				});
 		});
-
-	m_FinalImage->SetData(m_ImageData);
-
-	if (m_Settings.Accumulate)
-		m_FrameIndex++;
-	else
-		m_FrameIndex = 1;
 }
 
+// Devirtualized material dispatch, cases for materials outside the kernel's set compile away
+template<uint32_t Features>
+static bool Scatter(const Material* material, Ray& ray, const HitPayload& payload, SampleStream& sampler)
+{
+	switch (material->matType)
+	{
+	case materialType::DiffuseMat:
+		if constexpr ((Features & KernelFeature::Diffuse) != 0)
+			return static_cast<const Diffuse*>(material)->Diffuse::scatter(ray, payload, sampler);
+		break;
+	case materialType::MetalMat:
+		if constexpr ((Features & KernelFeature::Metal) != 0)
+			return static_cast<const Metal*>(material)->Metal::scatter(ray, payload, sampler);
+		break;
+	case materialType::DialectricMat:
+		if constexpr ((Features & KernelFeature::Dialectric) != 0)
+			return static_cast<const Dialectric*>(material)->Dialectric::scatter(ray, payload, sampler);
+		break;
+	default:
+		break;
+	}
+	return material->scatter(ray, payload, sampler);
+}
 
+static float PowerHeuristic(float pdf, float otherPdf)
+{
+	float a = pdf * pdf, b = otherPdf * otherPdf;
+	return a / (a + b);
+}
 
+template<uint32_t Features>
 glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 {
-	Ray ray;
-	ray.Origin = m_ActiveCamera->GetPosition();
-	ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
-	
+	Ray ray = GeneratePrimaryRay(x, y);
+
 	glm::vec3 light(0.0f);
 	glm::vec3 throughput(1.0f); //  also called contribution
 
-	uint32_t seed = x + y * m_FinalImage->GetWidth();
-	seed *= m_FrameIndex;
+	// Frames are the sample index, each bounce reads its own block of dimensions
+	SampleStream sampler(*m_Sampler, x, y, m_FrameIndex - 1 + m_Settings.SampleIndexOffset);
+
+	// Ray cone for texture filtering: width grows with distance, spread widens after each bounce
+	float coneWidth = 0.0f;
+	float coneSpread = m_PixelSpreadAngle;
+
+	const EnvironmentMap* environment = nullptr;
+	if constexpr ((Features & KernelFeature::Environment) != 0)
+		environment = m_ActiveScene->Environment.get();
+	bool sampleEnvironment = environment && m_Settings.SampleEnvironment;
+	bool sampleLights = false;
+	if constexpr ((Features & KernelFeature::Lights) != 0)
+		sampleLights = m_Settings.SampleLights;
+	// Solid-angle pdf of the last scattered direction, 0 for camera rays and bounces without
+	// a known pdf; those see the environment and emitters at full weight
+	float bsdfPdf = 0.0f;
+	glm::vec3 bsdfNormal(0.0f); // Normal at the point that pdf belongs to
 
-	int bounces = 15;
+	GuidingField* guiding = nullptr;
+	if constexpr ((Features & KernelFeature::Guiding) != 0)
+		guiding = m_Guiding.get();
+	std::conditional_t<(Features & KernelFeature::Guiding) != 0, GuidingPath, NoGuidingPath> path;
+
+	int bounces = m_Settings.Bounces;
 	for (int i = 0; i < bounces; i++)
 	{
-		seed += i;
-		HitPayload payload = TraceRay(ray);
+		sampler.StartBounce(i);
+		HitPayload payload = i == 0 ? TracePrimaryRay<Features>(ray, x, y) : TraceRay<Features>(ray);
 		if (payload.HitDistance < 0.0f)
 		{
+			if constexpr ((Features & KernelFeature::Environment) != 0)
+			{
+				if (environment)
+				{
+					glm::vec3 direction = glm::normalize(ray.Direction);
+					float weight = sampleEnvironment && bsdfPdf > 0.0f ? PowerHeuristic(bsdfPdf, environment->Pdf(direction)) : 1.0f;
+					light += environment->Evaluate(direction) * throughput * weight;
+					break;
+				}
+			}
+
+			if (m_ActiveScene->UseSkyLight)
+			{
+				light += m_ActiveScene->SkyLight * throughput;
+				break;
+			}
+
 			glm::vec3 unit_direction = glm::normalize(ray.Direction);
 			float a = 0.5f * (unit_direction.y + 1.0f);
 			light += ((1.0f - a) * glm::vec3(1.0f, 1.0f, 1.0f) + a * glm::vec3(0.5f, 0.7f, 1.0f)) * throughput;
-
-			//light += m_ActiveScene->SkyLight * throughput;
 			break;
 		}
 
-		const Sphere* sphere = m_ActiveScene->Spheres[payload.ObjectIndex];
-		const Material* material = m_ActiveScene->Materials[sphere->MaterialIndex];
+		const Material* material = m_ActiveScene->Materials[payload.MaterialIndex];
 
-		throughput *= material->Albedo;	
-		//light += material.GetEmission();  
+		glm::vec3 albedo = material->Albedo;
+		if constexpr ((Features & KernelFeature::Textures) != 0)
+		{
+			coneWidth += coneSpread * payload.HitDistance;
+			coneSpread += ConeSpreadPerBounce;
+			if (material->AlbedoTexture >= 0)
+			{
+				const TextureCache& textures = m_ActiveScene->Textures;
+				float footprint = coneWidth * payload.UVPerWorldUnit * (float)textures.GetMaxDimension(material->AlbedoTexture);
+				albedo *= textures.Sample(material->AlbedoTexture, payload.UV, std::log2(std::max(footprint, 1e-8f)));
+			}
+		}
+
+		if constexpr ((Features & KernelFeature::AOVs) != 0)
+		{
+			if (i == 0 && m_Settings.OutputAOVs)
+			{
+				size_t pixel = (size_t)x + (size_t)y * m_Width;
+				m_AlbedoData[pixel] += albedo;
+				m_NormalData[pixel] += payload.WorldNormal;
+				m_DepthData[pixel] += payload.HitDistance;
+			}
+		}
+
+		if constexpr ((Features & KernelFeature::Emissive) != 0)
+		{
+			if (material->matType == materialType::EmissiveMat)
+			{
+				// Emitters hit after a diffuse bounce could also have been reached by SampleLight
+				float weight = 1.0f;
+				if constexpr ((Features & KernelFeature::Lights) != 0)
+				{
+					if (sampleLights && bsdfPdf > 0.0f && payload.Type == PrimitiveType::Sphere && payload.InstanceIndex < 0)
+						weight = PowerHeuristic(bsdfPdf, SphereLightPdf(ray.Origin, bsdfNormal, payload.ObjectIndex));
+				}
+				light += static_cast<const Emissive*>(material)->GetEmission() * throughput * weight;
+				break;
+			}
+		}
+
+		throughput *= albedo;	
 		ray.Origin = payload.WorldPosition + payload.WorldNormal * 0.0001f;
-		if (!material->scatter(ray, payload, seed)) {
-			light = glm::vec3(0.0f);
+
+		// Where the field has learned something, diffuse bounces pick guiding or cosine sampling
+		// at random and divide by the pdf of that mixture (one-sample MIS)
+		bool guidedVertex = false;
+		uint32_t region = 0;
+		const DirectionalTree* guide = nullptr;
+		if constexpr ((Features & KernelFeature::Guiding) != 0)
+		{
+			guidedVertex = guiding && material->matType == materialType::DiffuseMat;
+			if (guidedVertex)
+			{
+				region = guiding->FindRegion(payload.WorldPosition);
+				guide = guiding->GetDistribution(region);
+			}
+		}
+
+		// Next-event estimation below needs the throughput up to this vertex, so the scatter
+		// weight is applied after it; paths that scatter below the surface end after it
+		glm::vec3 scatterWeight(1.0f);
+		float scatterPdf = 0.0f;
+		bool absorbed = false;
+		if (guide)
+		{
+			sampler.Seek(7);
+			bool guided = sampler.Next1D() < m_Settings.GuidingProbability;
+			sampler.Seek(0);
+			if (guided)
+				ray.Direction = guide->Sample(sampler.Next2D());
+			else
+				Scatter<Features>(material, ray, payload, sampler);
+
+			float cosTheta = glm::dot(ray.Direction, payload.WorldNormal);
+			if (cosTheta > 0.0f)
+			{
+				scatterPdf = DiffusePdf(guide, ray.Direction, cosTheta);
+				scatterWeight = glm::vec3(cosTheta * glm::one_over_pi<float>() / scatterPdf);
+			}
+			else
+			{
+				absorbed = true;
+			}
+		}
+		else
+		{
+			absorbed = !Scatter<Features>(material, ray, payload, sampler);
+			if (!absorbed && material->matType == materialType::DiffuseMat)
+				scatterPdf = std::max(glm::dot(ray.Direction, payload.WorldNormal), 0.0f) * glm::one_over_pi<float>();
+		}
+
+		// Diffuse bounces also sample the environment and the lights directly, with dimensions
+		// scatter left unused. Each is weighted against BSDF sampling with the power heuristic.
+		if constexpr ((Features & (KernelFeature::Environment | KernelFeature::Lights)) != 0)
+		{
+			bsdfPdf = 0.0f;
+			if (material->matType == materialType::DiffuseMat)
+			{
+				bsdfPdf = scatterPdf;
+				bsdfNormal = payload.WorldNormal;
+				if constexpr ((Features & KernelFeature::Environment) != 0)
+				{
+					if (sampleEnvironment)
+					{
+						sampler.Seek(2);
+						glm::vec3 direction;
+						float environmentPdf;
+						glm::vec3 radiance = environment->Sample(sampler.Next2D(), direction, environmentPdf);
+						float cosTheta = glm::dot(direction, payload.WorldNormal);
+						if (environmentPdf > 0.0f && cosTheta > 0.0f)
+						{
+							Ray shadowRay;
+							shadowRay.Origin = ray.Origin;
+							shadowRay.Direction = direction;
+							if (TraceRay<Features>(shadowRay).HitDistance < 0.0f)
+							{
+								float diffuse = cosTheta * glm::one_over_pi<float>();
+								light += throughput * radiance * (diffuse / environmentPdf) * PowerHeuristic(environmentPdf, DiffusePdf(guide, direction, cosTheta));
+							}
+						}
+					}
+				}
+				if constexpr ((Features & KernelFeature::Lights) != 0)
+				{
+					if (sampleLights)
+						light += throughput * SampleLight<Features>(payload, ray.Origin, guide, sampler);
+				}
+			}
+		}
+
+		if (absorbed)
 			break;
+		throughput *= scatterWeight;
+
+		if constexpr ((Features & KernelFeature::Guiding) != 0)
+		{
+			if (guidedVertex && path.Count < MaxGuidingVertices)
+				path.Vertices[path.Count++] = { region, ray.Direction, throughput, light, scatterPdf };
 		}
+	}
 
+	// Radiance each vertex received along its bounce: what the path gathered after it, divided
+	// by the throughput up to there. Recorded over the pdf, so the field estimates flux.
+	if constexpr ((Features & KernelFeature::Guiding) != 0)
+	{
+		for (int v = 0; v < path.Count; v++)
+		{
+			const GuidingVertex& vertex = path.Vertices[v];
+			glm::vec3 incident = (light - vertex.Light) / glm::max(vertex.Throughput, glm::vec3(1e-8f));
+			guiding->Record(vertex.Region, vertex.Direction, Utils::Luminance(incident) / vertex.Pdf);
+		}
 	}
-#define GM 1
-#if GM
-	return glm::vec4(linearToGamma(light), 1.0f);
-#else
-	return glm::vec4(light, 1.0f);
-#endif
 
+	if constexpr ((Features & KernelFeature::Gamma) != 0)
+		return glm::vec4(linearToGamma(light), 1.0f);
+	else
+		return glm::vec4(light, 1.0f);
+}
+
+float Renderer::DiffusePdf(const DirectionalTree* guide, const glm::vec3& direction, float cosTheta) const
+{
+	float cosinePdf = cosTheta * glm::one_over_pi<float>();
+	if (!guide)
+		return cosinePdf;
+	return glm::mix(cosinePdf, guide->Pdf(direction), m_Settings.GuidingProbability);
+}
+
+float Renderer::DistantLightProbability() const
+{
+	// The light BVH counts as a single light next to each distant one, as in pbrt-v4
+	float distant = (float)DistantLightCount();
+	if (distant == 0.0f)
+		return 0.0f;
+	float spheres = m_Settings.UseLightBVH ? (m_LightTree.Empty() ? 0.0f : 1.0f) : (float)m_LightSpheres.size();
+	return distant / (distant + spheres);
+}
+
+// Cone of directions a sphere subtends from a point, 1 - cos of its half angle; 0 from inside
+static float SphereConeOneMinusCos(const glm::vec3& point, const Sphere& sphere)
+{
+	glm::vec3 toCenter = sphere.Position - point;
+	float distanceSquared = glm::dot(toCenter, toCenter);
+	float radiusSquared = sphere.Radius * sphere.Radius;
+	if (distanceSquared <= radiusSquared)
+		return 0.0f;
+
+	// sin^2 / (1 + cos) keeps precision for small, distant spheres
+	float sinThetaMaxSquared = radiusSquared / distanceSquared;
+	float cosThetaMax = std::sqrt(1.0f - sinThetaMaxSquared);
+	return sinThetaMaxSquared / (1.0f + cosThetaMax);
+}
+
+float Renderer::SphereLightPdf(const glm::vec3& point, const glm::vec3& normal, int sphereIndex) const
+{
+	int light = sphereIndex < (int)m_SphereLights.size() ? m_SphereLights[sphereIndex] : -1;
+	if (light < 0)
+		return 0.0f;
+
+	float oneMinusCosThetaMax = SphereConeOneMinusCos(point, *m_ActiveScene->Spheres[sphereIndex]);
+	if (oneMinusCosThetaMax <= 0.0f)
+		return 0.0f;
+
+	float pmf = m_Settings.UseLightBVH ? m_LightTree.Pmf(point, normal, (uint32_t)light) : 1.0f / (float)m_LightSpheres.size();
+	pmf *= 1.0f - DistantLightProbability();
+	return pmf / (glm::two_pi<float>() * oneMinusCosThetaMax);
+}
+
+template<uint32_t Features>
+glm::vec3 Renderer::SampleLight(const HitPayload& payload, const glm::vec3& origin, const DirectionalTree* guide, SampleStream& sampler)
+{
+	const Scene& scene = *m_ActiveScene;
+	if (DistantLightCount() == 0 && m_LightSpheres.empty())
+		return glm::vec3(0.0f);
+
+	sampler.Seek(4);
+	float u = sampler.Next1D();
+	glm::vec2 uLight = sampler.Next2D();
+
+	Ray shadowRay;
+	shadowRay.Origin = origin;
+
+	float distantProbability = DistantLightProbability();
+	if (u < distantProbability)
+	{
+		// Distant lights deliver Col as irradiance from -Dir, a delta BSDF sampling never finds
+		size_t count = DistantLightCount();
+		const Light* distant = scene.Lights[std::min((size_t)(u / distantProbability * (float)count), count - 1)];
+		shadowRay.Direction = -glm::normalize(distant->Dir);
+		float cosTheta = glm::dot(shadowRay.Direction, payload.WorldNormal);
+		if (cosTheta <= 0.0f || TraceRay<Features>(shadowRay).HitDistance >= 0.0f)
+			return glm::vec3(0.0f);
+
+		float pmf = distantProbability / (float)count;
+		return distant->Col * cosTheta * glm::one_over_pi<float>() / pmf;
+	}
+
+	if (m_LightSpheres.empty())
+		return glm::vec3(0.0f);
+
+	u = std::min((u - distantProbability) / (1.0f - distantProbability), 0x1.fffffep-1f);
+	uint32_t light;
+	float pmf;
+	if (m_Settings.UseLightBVH)
+	{
+		if (!m_LightTree.Sample(origin, payload.WorldNormal, u, light, pmf))
+			return glm::vec3(0.0f);
+	}
+	else
+	{
+		light = std::min((uint32_t)(u * (float)m_LightSpheres.size()), (uint32_t)m_LightSpheres.size() - 1);
+		pmf = 1.0f / (float)m_LightSpheres.size();
+	}
+	pmf *= 1.0f - distantProbability;
+
+	// Uniform direction inside the cone the sphere subtends
+	int sphereIndex = (int)m_LightSpheres[light];
+	const Sphere& sphere = *scene.Spheres[sphereIndex];
+	float oneMinusCosThetaMax = SphereConeOneMinusCos(origin, sphere);
+	if (oneMinusCosThetaMax <= 0.0f)
+		return glm::vec3(0.0f);
+
+	float oneMinusCosTheta = uLight.x * oneMinusCosThetaMax;
+	float cosTheta = 1.0f - oneMinusCosTheta;
+	float sinTheta = std::sqrt(std::max(oneMinusCosTheta * (2.0f - oneMinusCosTheta), 0.0f));
+	float phi = glm::two_pi<float>() * uLight.y;
+	glm::vec3 axis = glm::normalize(sphere.Position - origin);
+	shadowRay.Direction = Utils::ToWorld(axis, glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta));
+
+	float cosSurface = glm::dot(shadowRay.Direction, payload.WorldNormal);
+	if (cosSurface <= 0.0f)
+		return glm::vec3(0.0f);
+
+	// Every direction in the cone hits the sphere, anything closer is an occluder
+	HitPayload hit = TraceRay<Features>(shadowRay);
+	if (hit.HitDistance < 0.0f || hit.Type != PrimitiveType::Sphere || hit.ObjectIndex != sphereIndex || hit.InstanceIndex >= 0)
+		return glm::vec3(0.0f);
+
+	float lightPdf = pmf / (glm::two_pi<float>() * oneMinusCosThetaMax);
+	float diffuse = cosSurface * glm::one_over_pi<float>();
+	glm::vec3 emission = static_cast<const Emissive*>(scene.Materials[sphere.MaterialIndex])->GetEmission();
+	return emission * (diffuse / lightPdf) * PowerHeuristic(lightPdf, DiffusePdf(guide, shadowRay.Direction, cosSurface));
 }
 
-HitPayload Renderer::ClosestHit(const Ray& ray, float hitDistance, int objectIndex)
+HitPayload Renderer::ClosestHit(const Ray& ray, float hitDistance, PrimitiveType type, int objectIndex, int instanceIndex)
 {
 	HitPayload payload;
 	payload.HitDistance = hitDistance;
+	payload.Type = type;
 	payload.ObjectIndex = objectIndex;
+	payload.InstanceIndex = instanceIndex;
 
+	if (instanceIndex >= 0)
+	{
+		// Hit point and normal in object space, then back to world space
+		const Instance& instance = m_ActiveScene->Instances[instanceIndex];
+		const Sphere& sphere = m_ActiveScene->SphereSets[instance.GeometryIndex]->Spheres[objectIndex];
+
+		glm::vec3 localOrigin = instance.InverseTransform * glm::vec4(ray.Origin, 1.0f);
+		glm::vec3 localDirection = instance.InverseTransform * glm::vec4(ray.Direction, 0.0f);
+		glm::vec3 localNormal = localOrigin + localDirection * hitDistance - sphere.Position;
+
+		payload.WorldPosition = ray.Origin + ray.Direction * hitDistance;
+		payload.WorldNormal = glm::normalize(glm::transpose(glm::mat3(instance.InverseTransform)) * localNormal);
+		payload.UV = Utils::SphereUV(localNormal / sphere.Radius);
+		// u wraps the circumference, instance scale taken from the x axis (uniform scale assumed)
+		float scale = glm::length(instance.Transform[0]);
+		payload.UVPerWorldUnit = 1.0f / (glm::two_pi<float>() * sphere.Radius * scale);
+		payload.MaterialIndex = instance.MaterialOverride >= 0 ? instance.MaterialOverride : sphere.MaterialIndex;
+		return payload;
+	}
 
-	const Sphere* closestSphere = m_ActiveScene->Spheres[objectIndex];
-	glm::vec3 origin = ray.Origin - closestSphere->Position;
-	payload.WorldPosition = origin + ray.Direction * hitDistance;
-	payload.WorldNormal = glm::normalize(payload.WorldPosition);
+	payload.WorldPosition = ray.Origin + ray.Direction * hitDistance;
+	switch (type)
+	{
+	case PrimitiveType::Plane:
+	{
+		// Flat primitives face the incoming ray, planar UVs in the basis around their normal
+		const Plane& plane = m_ActiveScene->Planes[objectIndex];
+		payload.WorldNormal = glm::dot(ray.Direction, plane.Normal) < 0.0f ? plane.Normal : -plane.Normal;
+		glm::vec3 offset = payload.WorldPosition - plane.Point;
+		payload.UV = glm::vec2(glm::dot(offset, Utils::ToWorld(plane.Normal, glm::vec3(1.0f, 0.0f, 0.0f))),
+			glm::dot(offset, Utils::ToWorld(plane.Normal, glm::vec3(0.0f, 1.0f, 0.0f)))) / plane.TextureScale;
+		payload.UVPerWorldUnit = 1.0f / plane.TextureScale;
+		payload.MaterialIndex = plane.MaterialIndex;
+		break;
+	}
+	case PrimitiveType::Disc:
+	{
+		const Disc& disc = m_ActiveScene->Discs[objectIndex];
+		payload.WorldNormal = glm::dot(ray.Direction, disc.Normal) < 0.0f ? disc.Normal : -disc.Normal;
+		glm::vec3 offset = payload.WorldPosition - disc.Center;
+		payload.UV = glm::vec2(glm::dot(offset, Utils::ToWorld(disc.Normal, glm::vec3(1.0f, 0.0f, 0.0f))),
+			glm::dot(offset, Utils::ToWorld(disc.Normal, glm::vec3(0.0f, 1.0f, 0.0f)))) / (2.0f * disc.Radius) + 0.5f;
+		payload.UVPerWorldUnit = 1.0f / (2.0f * disc.Radius);
+		payload.MaterialIndex = disc.MaterialIndex;
+		break;
+	}
+	case PrimitiveType::Box:
+	{
+		// Outward normal of the face the hit lies on, the axis where it is furthest out
+		const Box& box = m_ActiveScene->Boxes[objectIndex];
+		glm::vec3 extent = box.Max - box.Min;
+		glm::vec3 local = (payload.WorldPosition - (box.Min + box.Max) * 0.5f) / (extent * 0.5f);
+		glm::vec3 distance = glm::abs(local);
+		int axis = distance.x > distance.y ? (distance.x > distance.z ? 0 : 2) : (distance.y > distance.z ? 1 : 2);
+		payload.WorldNormal = glm::vec3(0.0f);
+		payload.WorldNormal[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
 
-	payload.WorldPosition += closestSphere->Position;
+		// Each face spans the unit square along the other two axes
+		int u = (axis + 1) % 3, v = (axis + 2) % 3;
+		payload.UV = glm::vec2((payload.WorldPosition[u] - box.Min[u]) / extent[u], (payload.WorldPosition[v] - box.Min[v]) / extent[v]);
+		payload.UVPerWorldUnit = 1.0f / std::max(extent[u], extent[v]);
+		payload.MaterialIndex = box.MaterialIndex;
+		break;
+	}
+	default:
+	{
+		// Relative to the center, keeps precision on large spheres
+		const Sphere* closestSphere = m_ActiveScene->Spheres[objectIndex];
+		glm::vec3 local = ray.Origin - closestSphere->Position + ray.Direction * hitDistance;
+		payload.WorldNormal = glm::normalize(local);
+		payload.WorldPosition = local + closestSphere->Position;
+		payload.UV = Utils::SphereUV(payload.WorldNormal);
+		payload.UVPerWorldUnit = 1.0f / (glm::two_pi<float>() * closestSphere->Radius);
+		payload.MaterialIndex = closestSphere->MaterialIndex;
+		break;
+	}
+	}
 
 	return payload;
 }
@@ -145,7 +854,8 @@ HitPayload Renderer::Miss(const Ray& ray)
 	return payload;
 }
 
-HitPayload Renderer::TraceRay(const Ray& ray)
+// Nearest positive root of the ray-sphere quadratic, or -1 on a miss
+static float IntersectSphere(const Ray& ray, const Sphere& sphere)
 {
 	// (bx^2 + by^2)t^2 + (2(axbx + ayby))t + (ax^2 + ay^2 - r^2) = 0
 	// where
@@ -153,45 +863,162 @@ HitPayload Renderer::TraceRay(const Ray& ray)
 	// b = ray direction
 	// r = radius
 	// t = hit radius
+	glm::vec3 origin = ray.Origin - sphere.Position;
 
-	int closestSphere = -1;
-	float hitDistance = std::numeric_limits<float>::max();
-	for (size_t i =0;i < m_ActiveScene->Spheres.size();i++)
-	{
-		const Sphere* sphere = m_ActiveScene->Spheres[i];
-		glm::vec3 origin = ray.Origin - sphere->Position;
+	float a = glm::dot(ray.Direction, ray.Direction);
+	float b = 2.0f * glm::dot(ray.Direction, origin);
+	float c = glm::dot(origin, origin) - sphere.Radius * sphere.Radius;
 
-		float a = glm::dot(ray.Direction, ray.Direction);
-		float b = 2.0f * glm::dot(ray.Direction, origin);
-		float c = glm::dot(origin, origin) - sphere->Radius * sphere->Radius;
-	
-		// Quadratic formula discriminant
-		// (b^2 - 4ac)
+	// Quadratic formula discriminant
+	// (b^2 - 4ac)
 
-		float discriminant = b * b - 4.0f * a * c;
+	float discriminant = b * b - 4.0f * a * c;
 
-		if (discriminant < 0)
-			continue;
+	if (discriminant < 0)
+		return -1.0f;
+
+	// (-b +- sqrt(discriminant)) / 2a
 
-		// (-b +- sqrt(discriminant)) / 2a
+	// float t0 = (-b + glm::sqrt(discriminant)) / (2.0f * a);
+	return (-b - glm::sqrt(discriminant)) / (2.0f * a);
+}
+
+// Ray parameter where the ray crosses the plane through point with this normal, -1 when parallel
+static float IntersectPlane(const Ray& ray, const glm::vec3& point, const glm::vec3& normal)
+{
+	float denominator = glm::dot(ray.Direction, normal);
+	if (denominator == 0.0f)
+		return -1.0f;
+	return glm::dot(point - ray.Origin, normal) / denominator;
+}
 
-		// float t0 = (-b + glm::sqrt(discriminant)) / (2.0f * a);
-		float closestT = (-b - glm::sqrt(discriminant)) / (2.0f * a);
-		if (closestT > 0.0f && closestT < hitDistance)
+static float IntersectPlane(const Ray& ray, const Plane& plane)
+{
+	return IntersectPlane(ray, plane.Point, plane.Normal);
+}
+
+static float IntersectDisc(const Ray& ray, const Disc& disc)
+{
+	float t = IntersectPlane(ray, disc.Center, disc.Normal);
+	glm::vec3 offset = ray.Origin + ray.Direction * t - disc.Center;
+	return glm::dot(offset, offset) <= disc.Radius * disc.Radius ? t : -1.0f;
+}
+
+// Slab test, the exit distance when the ray starts inside the box
+static float IntersectBox(const Ray& ray, const Box& box)
+{
+	glm::vec3 inverseDirection = 1.0f / ray.Direction;
+	glm::vec3 t0 = (box.Min - ray.Origin) * inverseDirection;
+	glm::vec3 t1 = (box.Max - ray.Origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float entry = std::max(std::max(tNear.x, tNear.y), tNear.z);
+	float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+	if (entry > exit || exit <= 0.0f)
+		return -1.0f;
+	return entry > 0.0f ? entry : exit;
+}
+
+struct PrimitiveHit
+{
+	float Distance;
+	PrimitiveType Type;
+	int Index;
+};
+
+// Closest hit within one primitive array, a loop without type dispatch
+template<typename Primitive, float (*Intersect)(const Ray&, const Primitive&)>
+static void FindClosest(const Ray& ray, const std::vector<Primitive>& primitives, PrimitiveType type, PrimitiveHit& closest)
+{
+	float distance = closest.Distance;
+	int index = -1;
+	for (size_t i = 0; i < primitives.size(); i++)
+	{
+		float t = Intersect(ray, primitives[i]);
+		if (t > 0.0f && t < distance)
 		{
-			hitDistance = closestT;
-			closestSphere = (int)i;
+			distance = t;
+			index = (int)i;
 		}
 	}
+	if (index >= 0)
+		closest = { distance, type, index };
+}
+
+template<uint32_t Features>
+HitPayload Renderer::TracePrimaryRay(const Ray& ray, uint32_t x, uint32_t y)
+{
+	if (m_FirstHitMode == FirstHitMode::Off)
+		return TraceRay<Features>(ray);
+
+	FirstHit& hit = m_FirstHits[((size_t)m_SubpixelIndex * m_Height + y) * m_Width + x];
+	if (m_FirstHitMode == FirstHitMode::Replay)
+		return hit.ObjectIndex < 0 ? Miss(ray) : ClosestHit(ray, hit.HitDistance, hit.Type, hit.ObjectIndex, hit.InstanceIndex);
+
+	HitPayload payload = TraceRay<Features>(ray);
+	hit.HitDistance = payload.HitDistance;
+	hit.Type = payload.Type;
+	hit.ObjectIndex = payload.HitDistance < 0.0f ? -1 : payload.ObjectIndex;
+	hit.InstanceIndex = payload.InstanceIndex;
+	return payload;
+}
 
-	if (closestSphere < 0)
+template<uint32_t Features>
+HitPayload Renderer::TraceRay(const Ray& ray)
+{
+	PrimitiveHit closest{ std::numeric_limits<float>::max(), PrimitiveType::Sphere, -1 };
+	int closestInstance = -1;
+	for (size_t i =0;i < m_ActiveScene->Spheres.size();i++)
+	{
+		float closestT = IntersectSphere(ray, *m_ActiveScene->Spheres[i]);
+		if (closestT > 0.0f && closestT < closest.Distance)
+		{
+			closest.Distance = closestT;
+			closest.Index = (int)i;
+		}
+	}
+
+	// One loop per primitive type, each only replaces the closest hit when it beats it
+	FindClosest<Plane, IntersectPlane>(ray, m_ActiveScene->Planes, PrimitiveType::Plane, closest);
+	FindClosest<Box, IntersectBox>(ray, m_ActiveScene->Boxes, PrimitiveType::Box, closest);
+	FindClosest<Disc, IntersectDisc>(ray, m_ActiveScene->Discs, PrimitiveType::Disc, closest);
+
+	// Two levels: instance bounds in world space, then the shared SphereSet in object space.
+	// The object-space direction is left unnormalized so t stays comparable across levels.
+	if constexpr ((Features & KernelFeature::Instances) != 0)
+	{
+		m_ActiveScene->InstanceAccel.Traverse(ray, closest.Distance, [&](uint32_t instanceIndex, float& tMax)
+			{
+				const Instance& instance = m_ActiveScene->Instances[instanceIndex];
+				const SphereSet* set = m_ActiveScene->SphereSets[instance.GeometryIndex];
+
+				Ray localRay;
+				localRay.Origin = instance.InverseTransform * glm::vec4(ray.Origin, 1.0f);
+				localRay.Direction = instance.InverseTransform * glm::vec4(ray.Direction, 0.0f);
+
+				set->Accel.Traverse(localRay, tMax, [&](uint32_t sphereIndex, float& t)
+					{
+						float closestT = IntersectSphere(localRay, set->Spheres[sphereIndex]);
+						if (closestT > 0.0f && closestT < t)
+						{
+							t = closestT;
+							closest = { closestT, PrimitiveType::Sphere, (int)sphereIndex };
+							closestInstance = (int)instanceIndex;
+						}
+					});
+			});
+	}
+
+	if (closest.Index < 0)
 		return Miss(ray);
 	
-	return ClosestHit(ray, hitDistance, closestSphere);
+	return ClosestHit(ray, closest.Distance, closest.Type, closest.Index, closestInstance);
 }
 
 Renderer::~Renderer()
 {
+	delete[] m_ImageData;
+	delete[] m_AccumulationData;
 }
 
 //
@@ -1,21 +1,84 @@
 #pragma once
 
+#ifndef HALIDE_HEADLESS
 #include "Walnut/Image.h"
+#endif
 
 #include "Camera.h"
 #include "Ray.h"
 #include "Scene.h"
 #include "HitPayload.h"
+#include "Sampler.h"
+#include "LightBVH.h"
+#include "PathGuiding.h"
 
 #include <memory>
+#include <string>
 #include <glm/glm.hpp>
 
+// Compile-time feature set of a render kernel. Gamma and Accumulate must match the settings
+// exactly, the content bits only need to cover what the scene contains. Guiding and AOVs
+// come from the settings too but only need covering, kernels with them still check.
+namespace KernelFeature
+{
+	enum : uint32_t
+	{
+		Gamma       = 1 << 0,
+		Accumulate  = 1 << 1,
+		Diffuse     = 1 << 2,
+		Metal       = 1 << 3,
+		Dialectric  = 1 << 4,
+		Emissive    = 1 << 5,
+		Instances   = 1 << 6,
+		Textures    = 1 << 7,
+		Environment = 1 << 8,
+		Lights      = 1 << 9,
+		Guiding     = 1 << 10,
+		AOVs        = 1 << 11,
+
+		Settings = Gamma | Accumulate,
+		Extras = Guiding | AOVs,
+		AllContent = Diffuse | Metal | Dialectric | Emissive | Instances | Textures | Environment | Lights | Extras
+	};
+}
+
 class Renderer
 {
 public:
 	struct Settings
 	{
 		bool Accumulate = true;
+		bool Gamma = true;
+		int Bounces = 15;
+		// Off runs the kernel with every content feature, as a baseline for the specialized ones
+		bool SpecializeKernels = true;
+		SamplerType Sampler = SamplerType::Sobol;
+		// Added to the frame index, keeps independent renders of the same view decorrelated
+		uint32_t SampleIndexOffset = 0;
+		// Anti-aliasing through a fixed set of sub-pixel positions per pixel, cycled over frames
+		bool JitterAA = false;
+		int SubpixelPositions = 4;
+		// Reuse primary hits while camera and scene are unchanged, the image is identical either way
+		bool CacheFirstHits = true;
+		// Environment light sampling at diffuse hits, MIS-weighted against BSDF sampling.
+		// Off finds the environment through BSDF sampling only.
+		bool SampleEnvironment = true;
+		// Next-event estimation at diffuse hits towards Scene::Lights and emissive spheres,
+		// MIS-weighted against BSDF sampling like the environment
+		bool SampleLights = true;
+		// Light the scene with Scene::Lights. Off by default: the built-in scenes carried
+		// distant lights long before they lit anything, and look as designed without them.
+		bool DistantLights = false;
+		// Pick emissive spheres through the light BVH, off picks them uniformly as a baseline
+		bool UseLightBVH = true;
+		// Learn incident radiance over frames and sample diffuse bounces from it, mixed with
+		// cosine sampling. The field survives camera moves and is rebuilt on scene edits.
+		bool PathGuiding = false;
+		float GuidingProbability = 0.5f; // Share of guided diffuse bounces once a region has learned
+		size_t GuidingMemoryBudget = (size_t)64 << 20;
+		// Albedo, world normal and distance of the primary hit, accumulated like the color.
+		// Change it together with ResetFrameIndex so the sums cover the same frames.
+		bool OutputAOVs = false;
 	};
 	int m_SamplesPerPixel = 16;
 
@@ -28,7 +91,32 @@ public:
 
 	~Renderer();
 
+#ifndef HALIDE_HEADLESS
 	std::shared_ptr<Walnut::Image> GetFinalImage() const { return m_FinalImage; };
+#endif
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	// Sum of all accumulated frames, divide by GetSampleCount() for the estimate
+	const glm::vec4* GetAccumulationData() const { return m_AccumulationData; }
+	uint32_t GetSampleCount() const { return m_Settings.Accumulate ? m_FrameIndex - 1 : 1; }
+	// AOV sums over the same frames as the accumulation, misses add zero. nullptr while
+	// OutputAOVs is off; pointers stay valid until the next resize or Render call that turns them off.
+	const glm::vec3* GetAlbedoData() const { return m_AlbedoData.empty() ? nullptr : m_AlbedoData.data(); }
+	const glm::vec3* GetNormalData() const { return m_NormalData.empty() ? nullptr : m_NormalData.data(); }
+	const float* GetDepthData() const { return m_DepthData.empty() ? nullptr : m_DepthData.data(); }
+
+	// First-hit cache memory, and whether the last Render call read its primary hits from it
+	size_t GetFirstHitCacheSize() const { return m_FirstHits.size() * sizeof(FirstHit); }
+	bool IsReplayingFirstHits() const { return m_FirstHitMode == FirstHitMode::Replay; }
+
+	// Learned path guiding field, nullptr while guiding is off
+	const GuidingField* GetGuidingField() const { return m_Guiding.get(); }
+
+	// Features of the kernel used by the last Render call
+	uint32_t GetActiveKernel() const { return m_ActiveKernel; }
+	static uint32_t GetSceneFeatures(const Scene& scene, const Settings& settings);
+	static std::string GetKernelName(uint32_t features);
 
 	void ResetFrameIndex() { m_FrameIndex = 1; }
 	Settings& GetSettings() { return m_Settings;  }
@@ -36,17 +124,61 @@ public:
 	inline glm::vec3 linearToGamma(glm::vec3 linVec) { return glm::vec3{ sqrt(linVec.x),sqrt(linVec.y),sqrt(linVec.z) }; };
 
 private:
+	// Primary hit of a pixel, ClosestHit rebuilds the payload from it. ObjectIndex < 0 is a miss.
+	struct FirstHit
+	{
+		float HitDistance;
+		PrimitiveType Type;
+		int ObjectIndex;
+		int InstanceIndex;
+	};
+	enum class FirstHitMode { Off, Record, Replay };
+
+	using KernelFn = void (Renderer::*)();
+	static KernelFn SelectKernel(uint32_t requiredFeatures, uint32_t& kernelFeatures);
+
+	template<uint32_t Features>
+	void RenderFrame();
 
+	template<uint32_t Features>
 	glm::vec4 PerPixel(uint32_t x, uint32_t y); // RayGen Shader
 
+	void PrepareFirstHits();
+	void PrepareLights();
+	void PrepareGuiding();
+	void PrepareAOVs();
+
+	Ray GeneratePrimaryRay(uint32_t x, uint32_t y) const;
+
+	template<uint32_t Features>
+	HitPayload TracePrimaryRay(const Ray& ray, uint32_t x, uint32_t y);
+	template<uint32_t Features>
 	HitPayload TraceRay(const Ray& ray);
-	HitPayload ClosestHit(const Ray& ray,float hitDistance, int objectIndex);
+	HitPayload ClosestHit(const Ray& ray, float hitDistance, PrimitiveType type, int objectIndex, int instanceIndex = -1);
 	HitPayload Miss(const Ray& ray);
 
+	// Direct light at a diffuse hit from one stochastically chosen light, before throughput
+	template<uint32_t Features>
+	glm::vec3 SampleLight(const HitPayload& payload, const glm::vec3& origin, const DirectionalTree* guide, SampleStream& sampler);
+	// Solid-angle pdf of SampleLight reaching a sphere from a shading point, 0 for non-lights
+	float SphereLightPdf(const glm::vec3& point, const glm::vec3& normal, int sphereIndex) const;
+	// Scene::Lights that light the scene, none while DistantLights is off
+	size_t DistantLightCount() const { return m_Settings.DistantLights ? m_ActiveScene->Lights.size() : 0; }
+	// Share of light samples that go to Scene::Lights rather than emissive spheres
+	float DistantLightProbability() const;
+	// Solid-angle pdf of a diffuse bounce direction: cosine-weighted, or mixed with guiding
+	float DiffusePdf(const DirectionalTree* guide, const glm::vec3& direction, float cosTheta) const;
+
 private:
+#ifndef HALIDE_HEADLESS
 	std::shared_ptr < Walnut::Image> m_FinalImage;
+#endif
+	uint32_t m_Width = 0, m_Height = 0;
 	Settings m_Settings;
 
+	std::unique_ptr<Sampler> m_Sampler;
+	SamplerType m_SamplerType = SamplerType::Sobol;
+
 	std::vector<uint32_t> m_ImageHorizontalIterator, m_ImageVerticalIterator;
 
 	const Scene* m_ActiveScene = nullptr;
@@ -56,5 +188,57 @@ private:
 	glm::vec4* m_AccumulationData = nullptr;
 
 	uint32_t m_FrameIndex = 1;
+	uint32_t m_ActiveKernel = 0;
+
+	std::vector<glm::vec3> m_AlbedoData, m_NormalData;
+	std::vector<float> m_DepthData;
+
+	// One layer of FirstHits per sub-pixel position, each filled by the first frame that uses it
+	std::vector<FirstHit> m_FirstHits;
+	std::vector<uint8_t> m_FirstHitLayerValid;
+	struct FirstHitKey
+	{
+		uint64_t SceneVersion = 0, CameraVersion = 0;
+		uint32_t Width = 0, Height = 0;
+		int Positions = 0;
+
+		bool operator==(const FirstHitKey& other) const
+		{
+			return SceneVersion == other.SceneVersion && CameraVersion == other.CameraVersion &&
+				Width == other.Width && Height == other.Height && Positions == other.Positions;
+		}
+	} m_FirstHitKey;
+	FirstHitMode m_FirstHitMode = FirstHitMode::Off;
+	uint32_t m_SubpixelIndex = 0; // Position used by the current frame
+
+	// Emissive spheres as light BVH entries, rebuilt when the scene version changes
+	LightBVH m_LightTree;
+	std::vector<uint32_t> m_LightSpheres; // Light to Scene::Spheres index
+	std::vector<int> m_SphereLights;      // Scene::Spheres to light index, -1 for non-emitters
+	uint64_t m_LightsVersion = 0;
+
+	std::unique_ptr<GuidingField> m_Guiding;
+	uint64_t m_GuidingVersion = 0;
+	// Diffuse vertex of the current path, recorded into the field once the path is done
+	struct GuidingVertex
+	{
+		uint32_t Region;
+		glm::vec3 Direction;
+		glm::vec3 Throughput; // Including this vertex's bounce
+		glm::vec3 Light;      // Path radiance before anything arriving along Direction
+		float Pdf;
+	};
+	static constexpr int MaxGuidingVertices = 32;
+	struct GuidingPath
+	{
+		GuidingVertex Vertices[MaxGuidingVertices];
+		int Count = 0;
+	};
+	struct NoGuidingPath {}; // Kernels without guiding keep no vertices
+
+	float m_PixelSpreadAngle = 0.0f;
+	// Rough lobe width added to the ray cone per bounce, blurs textures seen indirectly
+	static constexpr float ConeSpreadPerBounce = 0.1f;
+	static constexpr int MaxSubpixelPositions = 16;
 };
 
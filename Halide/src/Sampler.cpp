@@ -0,0 +1,258 @@
+#include "Sampler.h"
+
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+static uint32_t ReverseBits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+// Laine-Karras style hash, only flips bits based on lower bits (Burley 2020)
+static uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+// Owen scramble: permutation applied from the most significant bit down
+static uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+{
+	return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+static uint32_t SobolDimension0(uint32_t index)
+{
+	return ReverseBits(index);
+}
+
+// Primitive polynomial x + 1, v_k = v_(k-1) ^ (v_(k-1) >> 1)
+static uint32_t SobolDimension1(uint32_t index)
+{
+	uint32_t result = 0;
+	for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+	{
+		if (index & 1)
+			result ^= v;
+	}
+	return result;
+}
+
+static float ToUnitFloat(uint32_t x)
+{
+	// Top 24 bits keep the result strictly below 1
+	return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t PixelSeed(uint32_t x, uint32_t y, uint32_t dimension)
+{
+	return Utils::HashCombine(Utils::HashCombine(Utils::PCG_Hash(x), y), dimension);
+}
+
+std::unique_ptr<Sampler> Sampler::Create(SamplerType type)
+{
+	switch (type)
+	{
+	case SamplerType::Random:
+		return std::make_unique<RandomSampler>();
+	case SamplerType::BlueNoise:
+		return std::make_unique<BlueNoiseSampler>();
+	case SamplerType::Sobol:
+	default:
+		return std::make_unique<SobolSampler>();
+	}
+}
+
+// -- Random --
+
+float RandomSampler::Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const
+{
+	uint32_t seed = Utils::HashCombine(PixelSeed(x, y, dimension), sampleIndex);
+	return Utils::RandomFloat(seed);
+}
+
+glm::vec2 RandomSampler::Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const
+{
+	return { Get1D(x, y, sampleIndex, dimension), Get1D(x, y, sampleIndex, dimension + 1) };
+}
+
+// -- Sobol --
+
+float SobolSampler::Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const
+{
+	uint32_t seed = PixelSeed(x, y, dimension);
+	uint32_t index = NestedUniformScramble(sampleIndex, seed);
+	return ToUnitFloat(NestedUniformScramble(SobolDimension0(index), Utils::PCG_Hash(seed)));
+}
+
+glm::vec2 SobolSampler::Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const
+{
+	// Each dimension pair gets its own index shuffle, so pairs stay decorrelated while
+	// every pair on its own keeps the (0,2)-sequence stratification
+	uint32_t seed = PixelSeed(x, y, dimension);
+	uint32_t index = NestedUniformScramble(sampleIndex, seed);
+
+	uint32_t seedX = Utils::PCG_Hash(seed);
+	uint32_t seedY = Utils::PCG_Hash(seedX);
+	return {
+		ToUnitFloat(NestedUniformScramble(SobolDimension0(index), seedX)),
+		ToUnitFloat(NestedUniformScramble(SobolDimension1(index), seedY))
+	};
+}
+
+// -- Blue noise --
+
+// Void-and-cluster (Ulichney 1993) ranking of a toroidal MaskSize^2 grid, normalized to [0, 1)
+static std::vector<float> GenerateBlueNoiseMask()
+{
+	constexpr int size = (int)BlueNoiseSampler::MaskSize;
+	constexpr int count = size * size;
+	constexpr float sigma = 1.5f;
+
+	std::vector<float> kernel(count);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			int dx = std::min(x, size - x);
+			int dy = std::min(y, size - y);
+			kernel[x + y * size] = std::exp(-(float)(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+		}
+	}
+
+	std::vector<uint8_t> pattern(count, 0);
+	std::vector<float> energy(count, 0.0f);
+	auto splat = [&](int index, float sign)
+	{
+		int px = index % size, py = index / size;
+		for (int y = 0; y < size; y++)
+		{
+			int ky = ((y - py) + size) % size;
+			for (int x = 0; x < size; x++)
+				energy[x + y * size] += sign * kernel[((x - px) + size) % size + ky * size];
+		}
+	};
+	auto tightestCluster = [&]()
+	{
+		int best = -1;
+		for (int i = 0; i < count; i++)
+			if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+				best = i;
+		return best;
+	};
+	auto largestVoid = [&]()
+	{
+		int best = -1;
+		for (int i = 0; i < count; i++)
+			if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+				best = i;
+		return best;
+	};
+
+	// Initial binary pattern, then relax it until removing the tightest cluster
+	// would just put the point back into the largest void
+	int initialOnes = count / 10;
+	uint32_t seed = 0x9e3779b9u;
+	for (int placed = 0; placed < initialOnes;)
+	{
+		int index = (int)(Utils::PCG_Hash(seed++) % (uint32_t)count);
+		if (pattern[index])
+			continue;
+		pattern[index] = 1;
+		splat(index, 1.0f);
+		placed++;
+	}
+	for (int iteration = 0; iteration < count; iteration++)
+	{
+		int cluster = tightestCluster();
+		pattern[cluster] = 0;
+		splat(cluster, -1.0f);
+		int gap = largestVoid();
+		pattern[gap] = 1;
+		splat(gap, 1.0f);
+		if (gap == cluster)
+			break;
+	}
+
+	std::vector<int> rank(count, 0);
+	std::vector<uint8_t> initialPattern = pattern;
+	std::vector<float> initialEnergy = energy;
+
+	// Phase 1: rank the initial points by removing the tightest cluster
+	for (int r = initialOnes - 1; r >= 0; r--)
+	{
+		int cluster = tightestCluster();
+		pattern[cluster] = 0;
+		splat(cluster, -1.0f);
+		rank[cluster] = r;
+	}
+
+	// Phase 2 and 3: fill the remaining largest voids in order
+	pattern = initialPattern;
+	energy = initialEnergy;
+	for (int r = initialOnes; r < count; r++)
+	{
+		int gap = largestVoid();
+		pattern[gap] = 1;
+		splat(gap, 1.0f);
+		rank[gap] = r;
+	}
+
+	std::vector<float> mask(count);
+	for (int i = 0; i < count; i++)
+		mask[i] = ((float)rank[i] + 0.5f) / (float)count;
+	return mask;
+}
+
+static const std::vector<float>& GetBlueNoiseMask()
+{
+	static const std::vector<float> mask = GenerateBlueNoiseMask();
+	return mask;
+}
+
+BlueNoiseSampler::BlueNoiseSampler()
+	: m_Mask(GetBlueNoiseMask())
+{
+}
+
+// Different dimensions read the mask at a different toroidal offset
+static float BlueNoiseOffset(const std::vector<float>& mask, uint32_t x, uint32_t y, uint32_t dimension)
+{
+	constexpr uint32_t wrap = BlueNoiseSampler::MaskSize - 1;
+	uint32_t offset = Utils::PCG_Hash(dimension);
+	uint32_t mx = (x + offset) & wrap;
+	uint32_t my = (y + (offset >> 16)) & wrap;
+	return mask[mx + my * BlueNoiseSampler::MaskSize];
+}
+
+static float WrapUnit(float value)
+{
+	value -= std::floor(value);
+	return std::min(value, 0.99999994f);
+}
+
+float BlueNoiseSampler::Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const
+{
+	// R1 sequence, fract(sampleIndex * golden ratio) in 0.32 fixed point
+	return WrapUnit(BlueNoiseOffset(m_Mask, x, y, dimension) + ToUnitFloat(sampleIndex * 2654435769u));
+}
+
+glm::vec2 BlueNoiseSampler::Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const
+{
+	// R2 sequence (Roberts 2018), 1D golden ratio steps on both axes would put the points on a line
+	return {
+		WrapUnit(BlueNoiseOffset(m_Mask, x, y, dimension) + ToUnitFloat(sampleIndex * 3242174889u)),
+		WrapUnit(BlueNoiseOffset(m_Mask, x, y, dimension + 1) + ToUnitFloat(sampleIndex * 2447445417u))
+	};
+}
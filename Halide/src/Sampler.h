@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+enum class SamplerType {
+	Random = 0,
+	Sobol = 1,
+	BlueNoise = 2
+};
+
+// A sampler maps (pixel, sample index, dimension) to a value in [0, 1).
+// Sample index is the accumulated frame, dimension is the decision inside the path.
+class Sampler
+{
+public:
+	virtual ~Sampler() = default;
+
+	virtual float Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const = 0;
+	// Consumes dimension and dimension + 1
+	virtual glm::vec2 Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const = 0;
+
+	static std::unique_ptr<Sampler> Create(SamplerType type);
+};
+
+// Independent hashed PCG values, the old behaviour but decorrelated across pixels/frames/dimensions
+class RandomSampler : public Sampler
+{
+public:
+	float Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override;
+	glm::vec2 Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override;
+};
+
+// Owen-scrambled Sobol (0,2) points, padded per dimension pair with a shuffled sample index
+class SobolSampler : public Sampler
+{
+public:
+	float Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override;
+	glm::vec2 Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override;
+};
+
+// Blue-noise mask with a per-dimension toroidal shift, advanced over frames by the golden ratio
+class BlueNoiseSampler : public Sampler
+{
+public:
+	BlueNoiseSampler();
+
+	float Get1D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override;
+	glm::vec2 Get2D(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const override;
+
+	static constexpr uint32_t MaskSize = 64;
+private:
+	const std::vector<float>& m_Mask;
+};
+
+// Per-path cursor over a sampler. Every bounce starts at a fixed dimension offset so
+// the same decision always reads the same dimension, no matter what earlier bounces consumed.
+// Layout within a bounce: 0-1 scatter, 2-3 environment sample, 4 light selection,
+// 5-6 position on the light, 7 choice between guided and cosine sampling.
+struct SampleStream
+{
+	static constexpr uint32_t DimensionsPerBounce = 8;
+
+	const Sampler* Source = nullptr;
+	uint32_t X = 0, Y = 0;
+	uint32_t SampleIndex = 0;
+	uint32_t Dimension = 0;
+	uint32_t BounceStart = 0;
+
+	SampleStream(const Sampler& source, uint32_t x, uint32_t y, uint32_t sampleIndex)
+		: Source(&source), X(x), Y(y), SampleIndex(sampleIndex) {}
+
+	void StartBounce(uint32_t bounce) { Dimension = BounceStart = bounce * DimensionsPerBounce; }
+	// Jumps to a fixed offset in the current bounce's block, for decisions that are not always taken
+	void Seek(uint32_t offset) { Dimension = BounceStart + offset; }
+
+	float Next1D() { return Source->Get1D(X, Y, SampleIndex, Dimension++); }
+	glm::vec2 Next2D()
+	{
+		glm::vec2 u = Source->Get2D(X, Y, SampleIndex, Dimension);
+		Dimension += 2;
+		return u;
+	}
+};
@@ -1,25 +1,83 @@
 #include "Scene.h"
+
+#include <atomic>
+
 class Renderer;
 class Ray;
-bool Diffuse::scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const {
-	ray.Direction = glm::normalize(payload.WorldNormal + Utils::InUnitHemiSphere(seed));
+bool Diffuse::scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const {
+	ray.Direction = Utils::InUnitHemiSphere(payload.WorldNormal, sampler.Next2D());
 	return true;
 }
 
-bool Metal::scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const {
-	ray.Direction = glm::reflect(ray.Direction, payload.WorldNormal + Roughness * Utils::RandomVec3(seed, -0.5f, 0.5f));
+bool Metal::scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const {
+	ray.Direction = glm::reflect(ray.Direction, payload.WorldNormal) + Roughness * Utils::InUnitSphere(sampler.Next2D());
 	ray.Direction = glm::normalize(ray.Direction);
 	return (glm::dot(ray.Direction, payload.WorldNormal) > 0);
 }
 
-bool Dialectric::scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const {
+bool Dialectric::scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const {
 	return true;
 }
 
+// Light sources end the path, the renderer adds their emission
+bool Emissive::scatter(Ray& /*ray*/, const HitPayload& /*payload*/, SampleStream& /*sampler*/) const {
+	return false;
+}
+
 glm::vec3 Dialectric::refract(const glm::vec3& uv, const glm::vec3& n, float etai_over_etat)
 {
 	float cos_theta = fmin(glm::dot(-uv, n), 1.0);
 	glm::vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
 	glm::vec3 r_out_par = -(float)sqrt(fabs(1.0 - glm::length(r_out_perp) * glm::length(r_out_perp))) * n;
 	return r_out_par + r_out_perp;
+}
+
+void SphereSet::BuildAccel()
+{
+	std::vector<AABB> bounds(Spheres.size());
+	for (size_t i = 0; i < Spheres.size(); i++)
+	{
+		bounds[i].Grow(Spheres[i].Position - glm::vec3(Spheres[i].Radius));
+		bounds[i].Grow(Spheres[i].Position + glm::vec3(Spheres[i].Radius));
+	}
+	Accel.Build(bounds);
+}
+
+void Scene::BuildAccelerationStructures()
+{
+	for (SphereSet* set : SphereSets)
+		set->BuildAccel();
+
+	// World bounds of each instance: the transformed corners of its geometry bounds
+	std::vector<AABB> bounds(Instances.size());
+	for (size_t i = 0; i < Instances.size(); i++)
+	{
+		const Instance& instance = Instances[i];
+		const SphereSet* set = SphereSets[instance.GeometryIndex];
+		if (set->Accel.Empty())
+		{
+			// Nothing to hit, but the BVH build needs a valid box: a point at the instance origin
+			bounds[i].Grow(instance.Transform * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+			continue;
+		}
+
+		const AABB& local = set->Accel.GetBounds();
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point{
+				(corner & 1) ? local.Max.x : local.Min.x,
+				(corner & 2) ? local.Max.y : local.Min.y,
+				(corner & 4) ? local.Max.z : local.Min.z
+			};
+			bounds[i].Grow(instance.Transform * glm::vec4(point, 1.0f));
+		}
+	}
+	InstanceAccel.Build(bounds);
+	MarkEdited();
+}
+
+uint64_t Scene::NextVersion()
+{
+	static std::atomic<uint64_t> s_NextVersion{ 1 };
+	return s_NextVersion++;
 }
\ No newline at end of file
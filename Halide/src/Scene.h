@@ -6,6 +6,12 @@
 #include <string>
 #include "Utils.h"
 #include "HitPayload.h"
+#include "Sampler.h"
+#include "BVH.h"
+#include "Texture.h"
+#include "Environment.h"
+
+#include <memory>
 
 // Define materialType before any references to it
 enum class materialType {
@@ -22,13 +28,14 @@ struct Material
 public:
     glm::vec3 Albedo{ 1.0f };
     materialType matType = materialType::None;
+    int AlbedoTexture = -1; // Into Scene::Textures, multiplies Albedo
 
     Material() = default;
     Material(glm::vec3 albedo, materialType type = materialType::None)
         : Albedo(albedo), matType(type) {}
 
     virtual ~Material() = default;
-    virtual bool scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const = 0;
+    virtual bool scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const = 0;
 };
 
 // Derived Diffuse material
@@ -37,7 +44,7 @@ struct Diffuse : public Material
     Diffuse(glm::vec3 albedo)
         : Material(albedo, materialType::DiffuseMat) {}
 
-    bool scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const override;
+    bool scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const override;
 };
 
 // Derived Metal material with roughness
@@ -48,7 +55,7 @@ struct Metal : public Material
     Metal(glm::vec3 albedo, float roughness)
         : Material(albedo, materialType::MetalMat), Roughness(roughness) {}
 
-    bool scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const override;
+    bool scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const override;
 };
 
 // Derived Dialectric material with refraction index
@@ -60,7 +67,7 @@ struct Dialectric : public Material
     Dialectric(glm::vec3 albedo, float roughness, float IR)
         : Material(albedo, materialType::DialectricMat), Roughness(roughness), Refract_ind(IR) {}
 
-    bool scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const override;
+    bool scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const override;
     glm::vec3 refract(const glm::vec3& uv, const glm::vec3& n, float etai_over_etat);
 };
 
@@ -73,7 +80,8 @@ struct Emissive : public Material
     Emissive(glm::vec3 albedo, glm::vec3 emissiveColor, float emissivePower)
         : Material(albedo, materialType::EmissiveMat), EmissiveColor(emissiveColor), EmissivePower(emissivePower) {}
 
-    bool scatter(Ray& ray, const HitPayload& payload, uint32_t& seed) const override;
+    glm::vec3 GetEmission() const { return EmissiveColor * EmissivePower; }
+    bool scatter(Ray& ray, const HitPayload& payload, SampleStream& sampler) const override;
 };
 
 // Sphere struct with position, radius, and material index
@@ -87,6 +95,63 @@ struct Sphere
         : Position(pos), Radius(rad), MaterialIndex(matInd) {}
 };
 
+// Infinite plane through Point, seen from both sides. UVs repeat every TextureScale units.
+struct Plane
+{
+    glm::vec3 Point{ 0.0f };
+    glm::vec3 Normal{ 0.0f, 1.0f, 0.0f };
+    int MaterialIndex = 0;
+    float TextureScale = 1.0f;
+
+    Plane(glm::vec3 point, glm::vec3 normal, int matInd, float textureScale = 1.0f)
+        : Point(point), Normal(glm::normalize(normal)), MaterialIndex(matInd), TextureScale(textureScale) {}
+};
+
+// Axis-aligned box between Min and Max
+struct Box
+{
+    glm::vec3 Min{ -0.5f };
+    glm::vec3 Max{ 0.5f };
+    int MaterialIndex = 0;
+
+    Box(glm::vec3 min, glm::vec3 max, int matInd)
+        : Min(min), Max(max), MaterialIndex(matInd) {}
+};
+
+// Flat disc around Center, seen from both sides
+struct Disc
+{
+    glm::vec3 Center{ 0.0f };
+    glm::vec3 Normal{ 0.0f, 1.0f, 0.0f };
+    float Radius = 0.5f;
+    int MaterialIndex = 0;
+
+    Disc(glm::vec3 center, glm::vec3 normal, float rad, int matInd)
+        : Center(center), Normal(glm::normalize(normal)), Radius(rad), MaterialIndex(matInd) {}
+};
+
+// Shared geometry referenced by instances, spheres are in object space
+struct SphereSet
+{
+    std::vector<Sphere> Spheres;
+    BVH Accel; // Bottom level, built by Scene::BuildAccelerationStructures
+
+    void BuildAccel();
+};
+
+// Placement of a SphereSet: a 3x4 object-to-world transform and an optional material override
+struct Instance
+{
+    glm::mat4x3 Transform{ 1.0f };
+    glm::mat4x3 InverseTransform{ 1.0f };
+    int GeometryIndex = 0;
+    int MaterialOverride = -1; // -1 keeps the per-sphere material
+
+    Instance(int geometryIndex, const glm::mat4& transform, int materialOverride = -1)
+        : Transform(transform), InverseTransform(glm::inverse(transform)),
+          GeometryIndex(geometryIndex), MaterialOverride(materialOverride) {}
+};
+
 // Light struct with direction and color
 struct Light
 {
@@ -97,13 +162,38 @@ struct Light
         : Dir(direction), Col(color) {}
 };
 
-// Scene struct with vectors of lights, spheres, and materials
+// Scene struct with vectors of lights, primitives, and materials
 struct Scene
 {
     std::vector<Light*> Lights;
     std::vector<Sphere*> Spheres;
+    // Analytic primitives, stored by value per type so each gets its own intersection loop
+    std::vector<Plane> Planes;
+    std::vector<Box> Boxes;
+    std::vector<Disc> Discs;
     std::vector<Material*> Materials;
+    // Radiance of rays that escape while UseSkyLight is set, the built-in scenes use a gradient sky
     glm::vec3 SkyLight;
+    bool UseSkyLight = false;
+    // Lights everything that escapes instead of the sky
+    std::unique_ptr<EnvironmentMap> Environment;
+
+    // Instanced geometry, memory grows with SphereSets rather than with Instances
+    std::vector<SphereSet*> SphereSets;
+    std::vector<Instance> Instances;
+    BVH InstanceAccel; // Top level over instance world bounds
+
+    TextureCache Textures;
+
+    // Unique across all scenes and edits, renderers key their cached first hits and light
+    // BVH on it. Call MarkEdited after moving, resizing, adding or removing geometry and
+    // after changing emission.
+    uint64_t Version = NextVersion();
+    void MarkEdited() { Version = NextVersion(); }
+    static uint64_t NextVersion();
+
+    // Rebuild after adding or moving instances or editing a SphereSet, calls MarkEdited
+    void BuildAccelerationStructures();
 
     void add();
 };
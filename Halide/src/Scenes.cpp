@@ -0,0 +1,252 @@
+#include "Scenes.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+namespace Scenes
+{
+	void ThreeSpheres(Scene& scene)
+	{
+		scene.SkyLight = glm::vec3{ 0.6f, 0.7f, 0.9f };
+
+		Light* not_skyLight = new Light(glm::vec3{ -1.0f, -1.0f,-1.0f }, glm::vec3{ 0.6f, 0.7f, 0.9f });
+		scene.Lights.emplace_back(not_skyLight);
+
+		Diffuse* material_ground = new Diffuse(glm::vec3{ 0.8f, 0.8f, 0.0f });
+		scene.Materials.emplace_back(material_ground);
+
+		Diffuse* material_center = new Diffuse(glm::vec3{ 0.1f, 0.2f, 0.5f });
+		scene.Materials.emplace_back(material_center);
+
+		Metal* material_left = new Metal(glm::vec3{ 0.8f, 0.8f, 0.8f }, 0.0f);
+		scene.Materials.emplace_back(material_left);
+
+		Metal* material_right = new Metal(glm::vec3{ 0.8f, 0.6f, 0.2f }, 0.0f);
+		scene.Materials.emplace_back(material_right);
+
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, -0.5f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0);
+		scene.Spheres.push_back(new Sphere({ 0.0f, 0.0f, -1.2f }, 0.5f, 1));
+		scene.Spheres.push_back(new Sphere({ -1.0f, 0.0f, -1.0f }, 0.5f, 2));
+		scene.Spheres.push_back(new Sphere({ 1.0f, 0.0f, -1.0f }, 0.5f, 3));
+	}
+
+	void RoughMetals(Scene& scene)
+	{
+		ThreeSpheres(scene);
+		static_cast<Metal*>(scene.Materials[2])->Roughness = 0.3f;
+		static_cast<Metal*>(scene.Materials[3])->Roughness = 0.6f;
+	}
+
+	void SphereGrid(Scene& scene)
+	{
+		scene.SkyLight = glm::vec3{ 0.6f, 0.7f, 0.9f };
+
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.5f, 0.5f, 0.5f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.7f, 0.3f, 0.3f }));
+		scene.Materials.emplace_back(new Metal(glm::vec3{ 0.8f, 0.8f, 0.9f }, 0.1f));
+
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, -0.5f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0);
+		for (int z = 0; z < 6; z++)
+		{
+			for (int x = 0; x < 8; x++)
+			{
+				glm::vec3 position{ -2.8f + 0.8f * x, -0.25f, -0.5f - 0.8f * z };
+				scene.Spheres.push_back(new Sphere(position, 0.25f, 1 + (x + z) % 2));
+			}
+		}
+	}
+
+	void InstancedField(Scene& scene)
+	{
+		scene.SkyLight = glm::vec3{ 0.6f, 0.7f, 0.9f };
+
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.5f, 0.5f, 0.5f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.2f, 0.5f, 0.2f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.6f, 0.4f, 0.2f }));
+		scene.Materials.emplace_back(new Metal(glm::vec3{ 0.8f, 0.8f, 0.8f }, 0.2f));
+
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, -0.5f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0);
+
+		uint32_t seed = 1;
+		SphereSet* cluster = new SphereSet();
+		for (int i = 0; i < 32; i++)
+		{
+			glm::vec3 offset{ Utils::RandomFloat(seed, -1.0f, 1.0f), Utils::RandomFloat(seed, 0.0f, 1.5f), Utils::RandomFloat(seed, -1.0f, 1.0f) };
+			cluster->Spheres.emplace_back(offset * 0.3f, Utils::RandomFloat(seed, 0.05f, 0.15f), 1);
+		}
+		scene.SphereSets.push_back(cluster);
+
+		constexpr int gridSize = 200;
+		constexpr float spacing = 0.8f;
+		scene.Instances.reserve(gridSize * gridSize);
+		for (int z = 0; z < gridSize; z++)
+		{
+			for (int x = 0; x < gridSize; x++)
+			{
+				glm::vec3 position{ (x - gridSize / 2) * spacing, -0.5f, -1.0f - z * spacing };
+				glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+				transform = glm::rotate(transform, Utils::RandomFloat(seed, 0.0f, 6.2831853f), glm::vec3(0.0f, 1.0f, 0.0f));
+				transform = glm::scale(transform, glm::vec3(Utils::RandomFloat(seed, 0.6f, 1.2f)));
+
+				// Every fifth cluster is metal, the rest keep the cluster's own material
+				int materialOverride = (x + z) % 5 == 0 ? 3 : ((x * 7 + z) % 3 == 0 ? 2 : -1);
+				scene.Instances.emplace_back(0, transform, materialOverride);
+			}
+		}
+
+		scene.BuildAccelerationStructures();
+	}
+
+	void TexturedSpheres(Scene& scene)
+	{
+		ThreeSpheres(scene);
+
+		// 8k x 4k each, ~400 MB per texture as float tiles, more than the default budget
+		int ground = scene.Textures.AddTexture(std::make_unique<CheckerTextureSource>(8192, 4096, 2048,
+			glm::vec3{ 1.0f }, glm::vec3{ 0.3f }));
+		int center = scene.Textures.AddTexture(std::make_unique<CheckerTextureSource>(8192, 4096, 16,
+			glm::vec3{ 1.0f }, glm::vec3{ 0.2f, 0.2f, 0.6f }));
+
+		scene.Materials[0]->AlbedoTexture = ground;
+		scene.Planes[0].TextureScale = 512.0f; // Four checks per unit
+		scene.Materials[1]->Albedo = glm::vec3{ 1.0f };
+		scene.Materials[1]->AlbedoTexture = center;
+	}
+
+	void SunlitSpheres(Scene& scene)
+	{
+		ThreeSpheres(scene);
+
+		// Gradient sky over a dark ground, plus a sun 1.5 degrees wide that delivers about
+		// three times the sky's irradiance from ~0.03% of the sphere
+		constexpr uint32_t width = 1024, height = 512;
+		const glm::vec3 sunDirection = glm::normalize(glm::vec3{ 0.5f, 0.6f, 0.3f });
+		const float sunCosRadius = std::cos(glm::radians(1.5f));
+		std::vector<glm::vec3> texels((size_t)width * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float phi = (((float)x + 0.5f) / (float)width - 0.5f) * 6.2831853f;
+				float latitude = (((float)y + 0.5f) / (float)height - 0.5f) * 3.1415927f;
+				glm::vec3 direction{ std::cos(latitude) * std::cos(phi), std::sin(latitude), std::cos(latitude) * std::sin(phi) };
+
+				glm::vec3 radiance;
+				if (direction.y < 0.0f)
+					radiance = glm::vec3{ 0.15f, 0.13f, 0.1f };
+				else
+				{
+					float a = 0.5f * (direction.y + 1.0f);
+					radiance = (1.0f - a) * glm::vec3{ 1.0f } + a * glm::vec3{ 0.5f, 0.7f, 1.0f };
+				}
+				if (glm::dot(direction, sunDirection) > sunCosRadius)
+					radiance = glm::vec3{ 1.0f, 0.9f, 0.75f } * 3000.0f;
+
+				texels[(size_t)y * width + x] = radiance;
+			}
+		}
+		scene.Environment = std::make_unique<EnvironmentMap>(width, height, std::move(texels));
+	}
+
+	void Primitives(Scene& scene)
+	{
+		scene.SkyLight = glm::vec3{ 0.6f, 0.7f, 0.9f };
+
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.5f, 0.5f, 0.5f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.7f, 0.3f, 0.3f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.2f, 0.4f, 0.7f }));
+		scene.Materials.emplace_back(new Metal(glm::vec3{ 0.8f, 0.8f, 0.8f }, 0.05f));
+
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, -0.5f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0);
+		// Back wall, tilted so it catches the sky
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, 0.0f, -6.0f }, glm::vec3{ 0.0f, 0.3f, 1.0f }, 2);
+
+		scene.Boxes.emplace_back(glm::vec3{ -2.2f, -0.5f, -2.5f }, glm::vec3{ -1.2f, 0.5f, -1.5f }, 1);
+		scene.Boxes.emplace_back(glm::vec3{ 1.0f, -0.5f, -3.5f }, glm::vec3{ 1.6f, 1.3f, -2.9f }, 3);
+		scene.Boxes.emplace_back(glm::vec3{ -0.4f, -0.5f, -1.0f }, glm::vec3{ 0.4f, -0.3f, -0.2f }, 2);
+
+		scene.Discs.emplace_back(glm::vec3{ 0.0f, -0.29f, -0.6f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0.35f, 3);
+		scene.Discs.emplace_back(glm::vec3{ -0.2f, 0.6f, -3.0f }, glm::vec3{ 0.3f, 0.2f, 1.0f }, 0.7f, 1);
+
+		scene.Spheres.push_back(new Sphere({ 0.0f, 0.01f, -0.6f }, 0.3f, 1));
+	}
+
+	void LightThroughGap(Scene& scene)
+	{
+		scene.SkyLight = glm::vec3{ 0.6f, 0.7f, 0.9f };
+
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.7f, 0.7f, 0.7f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.7f, 0.3f, 0.3f }));
+		scene.Materials.emplace_back(new Metal(glm::vec3{ 0.9f, 0.9f, 0.9f }, 0.0f));
+
+		// Closed room 4 x 3 x 5 with 0.1 thick walls, the ceiling leaves a 0.15 wide slit open
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, -0.5f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0);
+		scene.Boxes.emplace_back(glm::vec3{ -2.1f, -0.5f, -5.1f }, glm::vec3{ -2.0f, 2.6f, 0.6f }, 1);
+		scene.Boxes.emplace_back(glm::vec3{ 2.0f, -0.5f, -5.1f }, glm::vec3{ 2.1f, 2.6f, 0.6f }, 0);
+		scene.Boxes.emplace_back(glm::vec3{ -2.1f, -0.5f, -5.1f }, glm::vec3{ 2.1f, 2.6f, -5.0f }, 0);
+		scene.Boxes.emplace_back(glm::vec3{ -2.1f, -0.5f, 0.5f }, glm::vec3{ 2.1f, 2.6f, 0.6f }, 0);
+		scene.Boxes.emplace_back(glm::vec3{ -2.1f, 2.5f, -5.1f }, glm::vec3{ 0.5f, 2.6f, 0.6f }, 0);
+		scene.Boxes.emplace_back(glm::vec3{ 0.65f, 2.5f, -5.1f }, glm::vec3{ 2.1f, 2.6f, 0.6f }, 0);
+
+		scene.Spheres.push_back(new Sphere({ -0.8f, 0.2f, -3.0f }, 0.7f, 2));
+		scene.Boxes.emplace_back(glm::vec3{ 0.6f, -0.5f, -3.2f }, glm::vec3{ 1.4f, 0.5f, -2.4f }, 1);
+	}
+
+	void ManyLights(Scene& scene)
+	{
+		scene.SkyLight = glm::vec3{ 0.0f };
+
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.6f, 0.6f, 0.6f }));
+		scene.Materials.emplace_back(new Diffuse(glm::vec3{ 0.7f, 0.3f, 0.3f }));
+		scene.Materials.emplace_back(new Metal(glm::vec3{ 0.8f, 0.8f, 0.9f }, 0.2f));
+
+		scene.Planes.emplace_back(glm::vec3{ 0.0f, -0.5f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, 0);
+		scene.Spheres.push_back(new Sphere({ -1.2f, 0.0f, -2.0f }, 0.5f, 1));
+		scene.Spheres.push_back(new Sphere({ 1.2f, 0.0f, -2.5f }, 0.5f, 2));
+
+		// Emitters spanning two orders of magnitude in power, so a few lights dominate each region
+		uint32_t seed = 7;
+		const int firstEmitter = (int)scene.Materials.size();
+		constexpr int emitterMaterials = 32;
+		for (int i = 0; i < emitterMaterials; i++)
+		{
+			glm::vec3 color = glm::mix(glm::vec3{ 1.0f, 0.5f, 0.2f }, glm::vec3{ 0.4f, 0.6f, 1.0f }, Utils::RandomFloat(seed));
+			float power = std::pow(10.0f, Utils::RandomFloat(seed, 0.5f, 2.5f));
+			scene.Materials.emplace_back(new Emissive(glm::vec3{ 1.0f }, color, power));
+		}
+
+		for (int i = 0; i < 1024; i++)
+		{
+			glm::vec3 position{ Utils::RandomFloat(seed, -8.0f, 8.0f), Utils::RandomFloat(seed, -0.4f, 2.0f), Utils::RandomFloat(seed, -16.0f, 1.0f) };
+			float radius = Utils::RandomFloat(seed, 0.02f, 0.06f);
+			int material = firstEmitter + (int)(Utils::RandomFloat(seed) * emitterMaterials) % emitterMaterials;
+			scene.Spheres.push_back(new Sphere(position, radius, material));
+		}
+
+		// Almost black surroundings, the emitters are the only significant light
+		scene.Environment = std::make_unique<EnvironmentMap>(4, 2, std::vector<glm::vec3>(8, glm::vec3{ 0.005f }));
+	}
+
+	BuildFn Find(const std::string& name)
+	{
+		static const struct { const char* Name; BuildFn Build; } scenes[] = {
+			{ "three_spheres",   ThreeSpheres },
+			{ "rough_metals",    RoughMetals },
+			{ "sphere_grid",     SphereGrid },
+			{ "instanced_field", InstancedField },
+			{ "textured",        TexturedSpheres },
+			{ "sunlit",          SunlitSpheres },
+			{ "primitives",      Primitives },
+			{ "light_gap",       LightThroughGap },
+			{ "many_lights",     ManyLights },
+		};
+
+		for (const auto& entry : scenes)
+		{
+			if (name == entry.Name)
+				return entry.Build;
+		}
+		return nullptr;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Scene.h"
+
+#include <string>
+
+// Built-in scenes shared by the viewer and the headless tools
+namespace Scenes
+{
+	// Ground plane, a diffuse sphere and two metal spheres
+	void ThreeSpheres(Scene& scene);
+
+	// Same layout with rough metals, mostly glossy indirect light
+	void RoughMetals(Scene& scene);
+
+	// Grid of small diffuse/metal spheres over the ground, lots of occlusion
+	void SphereGrid(Scene& scene);
+
+	// 40k instances of one 32-sphere cluster (1.28M visible spheres), two-level BVH
+	void InstancedField(Scene& scene);
+
+	// Three spheres with large procedural checker textures, exercises the texture cache
+	void TexturedSpheres(Scene& scene);
+
+	// Three spheres under a procedural HDR sky with a small, very bright sun, exercises
+	// environment importance sampling
+	void SunlitSpheres(Scene& scene);
+
+	// Ground and wall planes, boxes and discs around a sphere, every analytic primitive type
+	void Primitives(Scene& scene);
+
+	// Closed room lit only by sky through a slit in the ceiling, almost all light is
+	// indirect and hard to find by BSDF sampling; the path guiding test case
+	void LightThroughGap(Scene& scene);
+
+	// About a thousand small emissive spheres of varied color and power around a few objects,
+	// exercises the light BVH
+	void ManyLights(Scene& scene);
+
+	using BuildFn = void (*)(Scene&);
+
+	// Builder by snake_case name ("three_spheres", ...), nullptr when unknown
+	BuildFn Find(const std::string& name);
+}
@@ -0,0 +1,460 @@
+#include "Texture.h"
+
+#include "ImageIO.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+// -- Sources --
+
+PFMTextureSource::PFMTextureSource(const std::string& path)
+{
+	std::string stem = path.size() > 4 && path.compare(path.size() - 4, 4, ".pfm") == 0 ? path.substr(0, path.size() - 4) : path;
+	for (uint32_t level = 0; ; level++)
+	{
+		LevelFile file;
+		file.Path = level == 0 ? path : stem + ".mip" + std::to_string(level) + ".pfm";
+
+		ImageIO::PFMHeader header;
+		if (!ImageIO::ReadPFMHeader(file.Path, header))
+			break;
+
+		// Levels have to follow the cache's size chain to be usable
+		if (level > 0 && (header.Width != std::max(1u, m_Levels[0].Width >> level) || header.Height != std::max(1u, m_Levels[0].Height >> level)))
+			break;
+
+		file.Width = header.Width;
+		file.Height = header.Height;
+		file.Channels = header.Channels;
+		file.DataOffset = header.DataOffset;
+		m_Levels.push_back(file);
+
+		if (header.Width == 1 && header.Height == 1)
+			break;
+	}
+}
+
+void PFMTextureSource::ReadRegion(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec3* out) const
+{
+	const LevelFile& levelFile = m_Levels[level];
+
+	// Own stream per call, misses are rare enough and this keeps workers independent
+	std::ifstream file(levelFile.Path, std::ios::binary);
+	std::vector<float> row((size_t)width * levelFile.Channels);
+	for (uint32_t j = 0; j < height; j++)
+	{
+		size_t offset = levelFile.DataOffset + (((size_t)(y + j) * levelFile.Width + x) * levelFile.Channels) * sizeof(float);
+		file.seekg(offset);
+		file.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(float));
+		if (!file)
+		{
+			std::fill(out + (size_t)j * width, out + (size_t)(j + 1) * width, glm::vec3(1.0f, 0.0f, 1.0f));
+			file.clear();
+			continue;
+		}
+
+		for (uint32_t i = 0; i < width; i++)
+		{
+			const float* texel = &row[(size_t)i * levelFile.Channels];
+			out[(size_t)j * width + i] = levelFile.Channels == 3 ? glm::vec3(texel[0], texel[1], texel[2]) : glm::vec3(texel[0]);
+		}
+	}
+}
+
+// Integral of the square wave that is +1 on even checks and -1 on odd ones
+static double SquareWaveIntegral(double t)
+{
+	double f = t - 2.0 * std::floor(t * 0.5);
+	return f < 1.0 ? f : 2.0 - f;
+}
+
+// Mean of the square wave over [begin, end), in check units
+static float SquareWaveMean(double begin, double end)
+{
+	return (float)((SquareWaveIntegral(end) - SquareWaveIntegral(begin)) / (end - begin));
+}
+
+void CheckerTextureSource::ReadRegion(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec3* out) const
+{
+	// Texel footprints in check units; the 2D mean of the checks is the product of the
+	// 1D means because the pattern is sx * sy and the box is axis-aligned
+	double scaleX = (double)m_Checks / m_Width * (double)(1ull << level);
+	double scaleY = (double)m_Checks / m_Height * (double)(1ull << level);
+	for (uint32_t j = 0; j < height; j++)
+	{
+		float meanY = SquareWaveMean((y + j) * scaleY, (y + j + 1) * scaleY);
+		for (uint32_t i = 0; i < width; i++)
+		{
+			float mean = SquareWaveMean((x + i) * scaleX, (x + i + 1) * scaleX) * meanY;
+			out[(size_t)j * width + i] = m_ColorA * (0.5f + 0.5f * mean) + m_ColorB * (0.5f - 0.5f * mean);
+		}
+	}
+}
+
+// -- Cache --
+
+static std::atomic<uint64_t> s_NextCacheId{ 1 };
+
+// Last tiles this thread used, direct-mapped by key
+struct ThreadTileEntry
+{
+	uint64_t CacheId = 0;
+	uint64_t Key = 0;
+	std::shared_ptr<const void> Tile;
+};
+static constexpr uint32_t ThreadTileCount = 16;
+static thread_local ThreadTileEntry s_ThreadTiles[ThreadTileCount];
+
+// Advances whenever tiles get evicted, threads look for evicted entries only after it moved
+static std::atomic<uint64_t> s_EvictionEpoch{ 0 };
+static thread_local uint64_t s_SeenEvictionEpoch = 0;
+
+// Hits served from the thread list, counted for one cache at a time and flushed when the
+// cache changes, every HitFlushInterval hits and in FlushThreadState
+struct ThreadHitCount
+{
+	uint64_t CacheId = 0;
+	std::shared_ptr<std::atomic<uint64_t>> Counter;
+	uint32_t Pending = 0;
+
+	void Flush()
+	{
+		if (Pending > 0 && Counter)
+			Counter->fetch_add(Pending, std::memory_order_relaxed);
+		Pending = 0;
+	}
+	~ThreadHitCount() { Flush(); }
+};
+static constexpr uint32_t HitFlushInterval = 64;
+static thread_local ThreadHitCount s_ThreadHits;
+
+TextureCache::TextureCache(size_t memoryBudget)
+	: m_Shards(new Shard[ShardCount]), m_ShardBudget(memoryBudget / ShardCount), m_CacheId(s_NextCacheId++),
+	  m_ThreadHits(std::make_shared<std::atomic<uint64_t>>(0))
+{
+}
+
+TextureCache::~TextureCache()
+{
+	// Thread lists can outlive the cache, they release its tiles on their next sweep
+	for (uint32_t i = 0; i < ShardCount; i++)
+	{
+		for (const auto& [key, tile] : m_Shards[i].Tiles)
+			tile->Evicted.store(true, std::memory_order_relaxed);
+	}
+	s_EvictionEpoch.fetch_add(1, std::memory_order_release);
+}
+
+int TextureCache::AddTexture(std::unique_ptr<TextureSource> source)
+{
+	TextureInfo info;
+	uint32_t width = source->GetWidth(), height = source->GetHeight();
+	while (true)
+	{
+		info.LevelSizes.emplace_back(width, height);
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+	info.Source = std::move(source);
+
+	m_Textures.push_back(std::move(info));
+	return (int)m_Textures.size() - 1;
+}
+
+uint32_t TextureCache::GetMaxDimension(int texture) const
+{
+	const glm::uvec2& size = m_Textures[texture].LevelSizes[0];
+	return std::max(size.x, size.y);
+}
+
+void TextureCache::SetMemoryBudget(size_t bytes)
+{
+	// Shards shrink lazily, on their next insertion
+	m_ShardBudget = bytes / ShardCount;
+}
+
+uint64_t TextureCache::MakeKey(int texture, uint32_t level, uint32_t tileX, uint32_t tileY)
+{
+	// 16 bits texture, 5 bits level, 21 bits per tile coordinate
+	return ((uint64_t)texture << 47) | ((uint64_t)level << 42) | ((uint64_t)tileY << 21) | (uint64_t)tileX;
+}
+
+void TextureCache::TilePins::Pin(TilePtr&& tile)
+{
+	if (!tile)
+		return;
+	if (Count < InlineCount)
+		Inline[Count++] = std::move(tile);
+	else
+		Overflow.push_back(std::move(tile));
+}
+
+glm::vec3 TextureCache::Sample(int texture, const glm::vec2& uv, float lod) const
+{
+	const TextureInfo& info = m_Textures[texture];
+	float maxLevel = (float)(info.LevelSizes.size() - 1);
+	lod = glm::clamp(lod, 0.0f, maxLevel);
+
+	TilePins pins;
+	uint32_t level = (uint32_t)lod;
+	float t = lod - (float)level;
+	glm::vec3 fine = Bilinear(info, texture, level, uv, pins);
+	if (t <= 0.0f || level + 1 >= info.LevelSizes.size())
+		return fine;
+
+	return glm::mix(fine, Bilinear(info, texture, level + 1, uv, pins), t);
+}
+
+glm::vec3 TextureCache::Bilinear(const TextureInfo& info, int texture, uint32_t level, const glm::vec2& uv, TilePins& pins) const
+{
+	const glm::uvec2& size = info.LevelSizes[level];
+	float fx = (uv.x - std::floor(uv.x)) * (float)size.x - 0.5f;
+	float fy = (uv.y - std::floor(uv.y)) * (float)size.y - 0.5f;
+	float x0 = std::floor(fx), y0 = std::floor(fy);
+	float tx = fx - x0, ty = fy - y0;
+
+	// Repeat wrapping of the 2x2 footprint
+	auto wrap = [](int v, uint32_t extent) { return (uint32_t)(((v % (int)extent) + (int)extent) % (int)extent); };
+	uint32_t xs[2] = { wrap((int)x0, size.x), wrap((int)x0 + 1, size.x) };
+	uint32_t ys[2] = { wrap((int)y0, size.y), wrap((int)y0 + 1, size.y) };
+
+	// Almost every footprint lies inside one tile, it takes a single lookup
+	const Tile* tiles[2][2];
+	tiles[0][0] = GetTile(texture, level, xs[0] / TileSize, ys[0] / TileSize, pins);
+	bool splitX = xs[1] / TileSize != xs[0] / TileSize;
+	bool splitY = ys[1] / TileSize != ys[0] / TileSize;
+	tiles[0][1] = splitX ? GetTile(texture, level, xs[1] / TileSize, ys[0] / TileSize, pins) : tiles[0][0];
+	tiles[1][0] = splitY ? GetTile(texture, level, xs[0] / TileSize, ys[1] / TileSize, pins) : tiles[0][0];
+	tiles[1][1] = splitX && splitY ? GetTile(texture, level, xs[1] / TileSize, ys[1] / TileSize, pins) : (splitX ? tiles[0][1] : tiles[1][0]);
+
+	auto texel = [&](uint32_t i, uint32_t j) { return tiles[j][i]->Texels[(xs[i] % TileSize) + (ys[j] % TileSize) * TileSize]; };
+	glm::vec3 bottom = glm::mix(texel(0, 0), texel(1, 0), tx);
+	glm::vec3 top = glm::mix(texel(0, 1), texel(1, 1), tx);
+	return glm::mix(bottom, top, ty);
+}
+
+void TextureCache::CountThreadHit() const
+{
+	ThreadHitCount& count = s_ThreadHits;
+	if (count.CacheId != m_CacheId)
+	{
+		count.Flush();
+		count.CacheId = m_CacheId;
+		count.Counter = m_ThreadHits;
+	}
+	if (++count.Pending >= HitFlushInterval)
+		count.Flush();
+}
+
+void TextureCache::FlushThreadState()
+{
+	s_ThreadHits.Flush();
+	ReleaseEvictedThreadTiles(nullptr);
+}
+
+void TextureCache::ReleaseEvictedThreadTiles(TilePins* pins)
+{
+	uint64_t epoch = s_EvictionEpoch.load(std::memory_order_acquire);
+	if (epoch == s_SeenEvictionEpoch)
+		return;
+	s_SeenEvictionEpoch = epoch;
+
+	for (ThreadTileEntry& entry : s_ThreadTiles)
+	{
+		if (!entry.Tile || !static_cast<const Tile*>(entry.Tile.get())->Evicted.load(std::memory_order_relaxed))
+			continue;
+
+		// Pointers handed out earlier in the running sample must stay valid
+		entry.CacheId = 0;
+		if (pins)
+			pins->Pin(std::static_pointer_cast<const Tile>(std::move(entry.Tile)));
+		entry.Tile.reset();
+	}
+}
+
+const TextureCache::Tile* TextureCache::GetTile(int texture, uint32_t level, uint32_t tileX, uint32_t tileY, TilePins& pins) const
+{
+	uint64_t key = MakeKey(texture, level, tileX, tileY);
+	uint32_t hash = Utils::PCG_Hash((uint32_t)key ^ Utils::PCG_Hash((uint32_t)(key >> 32)));
+
+	// The entry keeps the tile alive, no reference counting on the fast path
+	ThreadTileEntry& entry = s_ThreadTiles[(hash >> 8) % ThreadTileCount];
+	if (entry.CacheId == m_CacheId && entry.Key == key && entry.Tile)
+	{
+		const Tile* tile = static_cast<const Tile*>(entry.Tile.get());
+		if (!tile->Referenced.load(std::memory_order_relaxed))
+			tile->Referenced.store(true, std::memory_order_relaxed);
+		CountThreadHit();
+		return tile;
+	}
+
+	Shard& shard = m_Shards[hash % ShardCount];
+	TilePtr tile;
+	{
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+		auto it = shard.Tiles.find(key);
+		if (it != shard.Tiles.end())
+			tile = it->second;
+	}
+
+	if (tile)
+	{
+		shard.Hits.fetch_add(1, std::memory_order_relaxed);
+		tile->Referenced.store(true, std::memory_order_relaxed);
+	}
+	else
+	{
+		// Load without holding the shard, other threads may race us to the same tile
+		shard.Misses.fetch_add(1, std::memory_order_relaxed);
+		TilePtr loaded = LoadTile(texture, level, tileX, tileY, pins);
+
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+		auto it = shard.Tiles.find(key);
+		if (it != shard.Tiles.end())
+		{
+			tile = it->second;
+		}
+		else
+		{
+			tile = loaded;
+			Insert(shard, key, tile);
+		}
+	}
+
+	ReleaseEvictedThreadTiles(&pins);
+	pins.Pin(std::static_pointer_cast<const Tile>(std::move(entry.Tile)));
+	entry.CacheId = m_CacheId;
+	entry.Key = key;
+	entry.Tile = tile;
+	return tile.get();
+}
+
+void TextureCache::Insert(Shard& shard, uint64_t key, const TilePtr& tile) const
+{
+	// Clock sweep: referenced tiles get their bit cleared and one more round, the first
+	// unreferenced one goes. Terminates within two passes over the shard.
+	size_t budget = m_ShardBudget.load(std::memory_order_relaxed);
+	while (shard.Memory + TileBytes > budget && !shard.Clock.empty())
+	{
+		if (shard.Hand >= shard.Clock.size())
+			shard.Hand = 0;
+
+		uint64_t candidate = shard.Clock[shard.Hand];
+		const TilePtr& resident = shard.Tiles[candidate];
+		if (resident->Referenced.load(std::memory_order_relaxed))
+		{
+			resident->Referenced.store(false, std::memory_order_relaxed);
+			shard.Hand++;
+			continue;
+		}
+
+		resident->Evicted.store(true, std::memory_order_relaxed);
+		shard.Tiles.erase(candidate);
+		shard.Clock[shard.Hand] = shard.Clock.back();
+		shard.Clock.pop_back();
+		shard.Memory -= TileBytes;
+		shard.Evictions.fetch_add(1, std::memory_order_relaxed);
+		s_EvictionEpoch.fetch_add(1, std::memory_order_release);
+	}
+
+	shard.Tiles.emplace(key, tile);
+	shard.Clock.push_back(key);
+	shard.Memory += TileBytes;
+}
+
+TextureCache::TilePtr TextureCache::LoadTile(int texture, uint32_t level, uint32_t tileX, uint32_t tileY, TilePins& pins) const
+{
+	const TextureInfo& info = m_Textures[texture];
+	const glm::uvec2& size = info.LevelSizes[level];
+
+	auto tile = std::make_shared<Tile>();
+	tile->Texels.resize(TileSize * TileSize);
+
+	uint32_t x0 = tileX * TileSize, y0 = tileY * TileSize;
+	uint32_t width = std::min(TileSize, size.x - x0);
+	uint32_t height = std::min(TileSize, size.y - y0);
+
+	if (level < info.Source->GetLevelCount())
+	{
+		std::vector<glm::vec3> region((size_t)width * height);
+		info.Source->ReadRegion(level, x0, y0, width, height, region.data());
+		for (uint32_t j = 0; j < height; j++)
+			std::copy_n(&region[(size_t)j * width], width, &tile->Texels[j * TileSize]);
+	}
+	else
+	{
+		// Box filter the (up to) 2x2 tiles of the level below, fetched through the cache
+		const glm::uvec2& childSize = info.LevelSizes[level - 1];
+		uint32_t childTilesX = (childSize.x + TileSize - 1) / TileSize;
+		uint32_t childTilesY = (childSize.y + TileSize - 1) / TileSize;
+
+		const Tile* children[2][2] = {};
+		for (uint32_t cy = 0; cy < 2; cy++)
+			for (uint32_t cx = 0; cx < 2; cx++)
+				if (tileX * 2 + cx < childTilesX && tileY * 2 + cy < childTilesY)
+					children[cy][cx] = GetTile(texture, level - 1, tileX * 2 + cx, tileY * 2 + cy, pins);
+
+		auto childTexel = [&](uint32_t x, uint32_t y)
+		{
+			x = std::min(x, childSize.x - 1);
+			y = std::min(y, childSize.y - 1);
+			const Tile& child = *children[y / TileSize - tileY * 2][x / TileSize - tileX * 2];
+			return child.Texels[(x % TileSize) + (y % TileSize) * TileSize];
+		};
+
+		for (uint32_t j = 0; j < height; j++)
+		{
+			for (uint32_t i = 0; i < width; i++)
+			{
+				uint32_t x = (x0 + i) * 2, y = (y0 + j) * 2;
+				tile->Texels[i + j * TileSize] = 0.25f * (childTexel(x, y) + childTexel(x + 1, y) + childTexel(x, y + 1) + childTexel(x + 1, y + 1));
+			}
+		}
+	}
+
+	// Pad partial edge tiles by clamping, keeps every texel of the tile defined
+	for (uint32_t j = 0; j < TileSize; j++)
+	{
+		for (uint32_t i = 0; i < TileSize; i++)
+		{
+			if (i < width && j < height)
+				continue;
+			tile->Texels[i + j * TileSize] = tile->Texels[std::min(i, width - 1) + std::min(j, height - 1) * TileSize];
+		}
+	}
+
+	return tile;
+}
+
+TextureCache::Stats TextureCache::GetStats() const
+{
+	Stats stats;
+	stats.Hits = m_ThreadHits->load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < ShardCount; i++)
+	{
+		Shard& shard = m_Shards[i];
+		stats.Hits += shard.Hits.load(std::memory_order_relaxed);
+		stats.Misses += shard.Misses.load(std::memory_order_relaxed);
+		stats.Evictions += shard.Evictions.load(std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+		stats.MemoryUsed += shard.Memory;
+	}
+	stats.MemoryBudget = m_ShardBudget.load() * ShardCount;
+	return stats;
+}
+
+void TextureCache::ResetStats()
+{
+	m_ThreadHits->store(0);
+	for (uint32_t i = 0; i < ShardCount; i++)
+	{
+		m_Shards[i].Hits = 0;
+		m_Shards[i].Misses = 0;
+		m_Shards[i].Evictions = 0;
+	}
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Where texels come from. Only the requested region is read, so sources backed by files
+// never have to be resident as a whole. Level n is max(1, size >> n) in each axis.
+class TextureSource
+{
+public:
+	virtual ~TextureSource() = default;
+
+	virtual uint32_t GetWidth() const = 0;
+	virtual uint32_t GetHeight() const = 0;
+	// Mip levels the source can read itself, the cache box-filters the remaining ones
+	virtual uint32_t GetLevelCount() const { return 1; }
+
+	// Row-major RGB texels of [x, x + width) x [y, y + height) of a level, row 0 is v = 0.
+	// Called concurrently from render workers.
+	virtual void ReadRegion(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec3* out) const = 0;
+};
+
+// Reads rows of uncompressed PFMs on demand. Pre-filtered levels are picked up from
+// "<name>.mip<n>.pfm" next to the file; without them every coarse tile the cache builds
+// reads all level-0 texels below it.
+class PFMTextureSource : public TextureSource
+{
+public:
+	PFMTextureSource(const std::string& path);
+
+	bool IsValid() const { return !m_Levels.empty(); }
+
+	uint32_t GetWidth() const override { return m_Levels[0].Width; }
+	uint32_t GetHeight() const override { return m_Levels[0].Height; }
+	uint32_t GetLevelCount() const override { return (uint32_t)m_Levels.size(); }
+	void ReadRegion(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec3* out) const override;
+private:
+	struct LevelFile
+	{
+		std::string Path;
+		uint32_t Width = 0, Height = 0;
+		uint32_t Channels = 0;
+		size_t DataOffset = 0;
+	};
+	std::vector<LevelFile> m_Levels;
+};
+
+// Procedural checkerboard, for tests and scenes without texture files.
+// Every level is the exact box filter of the checks, so all levels come from the source.
+class CheckerTextureSource : public TextureSource
+{
+public:
+	CheckerTextureSource(uint32_t width, uint32_t height, uint32_t checks, const glm::vec3& colorA, const glm::vec3& colorB)
+		: m_Width(width), m_Height(height), m_Checks(checks), m_ColorA(colorA), m_ColorB(colorB) {}
+
+	uint32_t GetWidth() const override { return m_Width; }
+	uint32_t GetHeight() const override { return m_Height; }
+	uint32_t GetLevelCount() const override { return 32; }
+	void ReadRegion(uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec3* out) const override;
+private:
+	uint32_t m_Width, m_Height, m_Checks;
+	glm::vec3 m_ColorA, m_ColorB;
+};
+
+// Tiled, mip-mapped texture cache under a memory budget.
+//
+// Tiles of every mip level are created lazily: from the source when it provides the level,
+// otherwise by box-filtering the four tiles below them through the cache. Tiles live in
+// shards, each with its own lock and an equal share of the budget, so there is no global lock.
+// Shards evict with the clock (second chance) algorithm: every use sets a tile's referenced
+// bit, and the clock hand spares referenced tiles once. Every thread also keeps a tiny
+// direct-mapped list of tiles it used last, which serves most lookups without touching a
+// shard at all and without reference counting.
+//
+// The budget is a soft limit: a tile evicted while threads still list it, or while a sample
+// reads it, stays in memory until those threads finish their current pixel (FlushThreadState)
+// or look up a tile that misses their list. Stats::MemoryUsed counts resident tiles only.
+class TextureCache
+{
+public:
+	static constexpr uint32_t TileSize = 32;
+
+	struct Stats
+	{
+		uint64_t Hits = 0;
+		uint64_t Misses = 0;
+		uint64_t Evictions = 0;
+		size_t MemoryUsed = 0;
+		size_t MemoryBudget = 0;
+	};
+
+	TextureCache(size_t memoryBudget = 256ull << 20);
+	~TextureCache();
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// Not thread-safe against concurrent Sample calls, add textures before rendering
+	int AddTexture(std::unique_ptr<TextureSource> source);
+	size_t GetTextureCount() const { return m_Textures.size(); }
+	uint32_t GetMaxDimension(int texture) const;
+
+	void SetMemoryBudget(size_t bytes);
+
+	// Trilinear lookup, lod is log2 of the footprint in level-0 texels. Wraps in u and v.
+	glm::vec3 Sample(int texture, const glm::vec2& uv, float lod) const;
+
+	// Hits served from the calling thread's tile list are counted locally and reach GetStats
+	// in batches, and evicted tiles leave the list lazily. Render workers call this when they
+	// finish a pixel, so the stats of a finished frame are exact and evicted tiles are freed.
+	static void FlushThreadState();
+
+	Stats GetStats() const;
+	void ResetStats();
+
+private:
+	struct Tile
+	{
+		std::vector<glm::vec3> Texels;
+		mutable std::atomic<bool> Referenced{ true }; // Clock bit, cleared as the hand passes
+		mutable std::atomic<bool> Evicted{ false };   // Out of its shard, or its cache is gone
+	};
+	using TilePtr = std::shared_ptr<const Tile>;
+
+	// Keeps tiles alive while a lookup uses raw pointers to them: a thread-list entry that
+	// gets replaced mid-lookup hands its tile over, so an earlier pointer cannot dangle
+	struct TilePins
+	{
+		static constexpr uint32_t InlineCount = 8;
+		TilePtr Inline[InlineCount];
+		uint32_t Count = 0;
+		std::vector<TilePtr> Overflow; // Only grows while LoadTile builds coarse levels
+
+		void Pin(TilePtr&& tile);
+	};
+
+	struct TextureInfo
+	{
+		std::unique_ptr<TextureSource> Source;
+		std::vector<glm::uvec2> LevelSizes;
+	};
+
+	struct Shard
+	{
+		std::mutex Mutex;
+		std::unordered_map<uint64_t, TilePtr> Tiles;
+		std::vector<uint64_t> Clock; // Keys in the order the hand visits them
+		size_t Hand = 0;
+		size_t Memory = 0;
+		std::atomic<uint64_t> Hits{ 0 }, Misses{ 0 }, Evictions{ 0 };
+	};
+
+	static constexpr uint32_t ShardCount = 64;
+	static constexpr size_t TileBytes = sizeof(Tile) + TileSize * TileSize * sizeof(glm::vec3);
+
+	static uint64_t MakeKey(int texture, uint32_t level, uint32_t tileX, uint32_t tileY);
+
+	glm::vec3 Bilinear(const TextureInfo& info, int texture, uint32_t level, const glm::vec2& uv, TilePins& pins) const;
+	const Tile* GetTile(int texture, uint32_t level, uint32_t tileX, uint32_t tileY, TilePins& pins) const;
+	TilePtr LoadTile(int texture, uint32_t level, uint32_t tileX, uint32_t tileY, TilePins& pins) const;
+	void Insert(Shard& shard, uint64_t key, const TilePtr& tile) const;
+	void CountThreadHit() const;
+	// Drops evicted tiles from the calling thread's list, into pins while a sample is running
+	static void ReleaseEvictedThreadTiles(TilePins* pins);
+
+private:
+	std::vector<TextureInfo> m_Textures;
+	std::unique_ptr<Shard[]> m_Shards;
+	std::atomic<size_t> m_ShardBudget;
+	uint64_t m_CacheId; // Tags thread-local entries, unlike the address it is never reused
+	// Thread-list hits, shared so threads can still flush into it after the cache is gone
+	std::shared_ptr<std::atomic<uint64_t>> m_ThreadHits;
+};
@@ -2,6 +2,10 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace Utils
 {
 	static uint32_t ConvertToRGBA(const glm::vec4& color)
@@ -44,13 +48,72 @@ namespace Utils
 		return glm::vec3{ RandomFloat(seed,min,max) };
 	}
 
-	static glm::vec3 InUnitSphere(uint32_t& seed) // For ray reflection
+	static uint32_t HashCombine(uint32_t seed, uint32_t value)
+	{
+		return PCG_Hash(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+	}
+
+	// Rec. 709 luminance of linear RGB
+	static float Luminance(const glm::vec3& color)
+	{
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	// Orthonormal basis around n (Duff et al. 2017), maps a local +Z direction to world space
+	static glm::vec3 ToWorld(const glm::vec3& n, const glm::vec3& local)
+	{
+		float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (sign + n.z);
+		float b = n.x * n.y * a;
+		glm::vec3 t{ 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x };
+		glm::vec3 s{ b, sign + n.y * n.y * a, -n.y };
+		return t * local.x + s * local.y + n * local.z;
+	}
+
+	// Shirley-Chiu concentric map, keeps the stratification of low-discrepancy points
+	static glm::vec2 ConcentricSampleDisk(const glm::vec2& u)
+	{
+		glm::vec2 offset = u * 2.0f - 1.0f;
+		if (offset.x == 0.0f && offset.y == 0.0f)
+			return glm::vec2(0.0f);
+
+		constexpr float quarterPi = 0.78539816339f;
+		float r, theta;
+		if (std::abs(offset.x) > std::abs(offset.y))
+		{
+			r = offset.x;
+			theta = quarterPi * (offset.y / offset.x);
+		}
+		else
+		{
+			r = offset.y;
+			theta = 2.0f * quarterPi - quarterPi * (offset.x / offset.y);
+		}
+		return r * glm::vec2(std::cos(theta), std::sin(theta));
+	}
+
+	static glm::vec3 InUnitSphere(const glm::vec2& u) // For ray reflection
+	{
+		constexpr float twoPi = 6.28318530718f;
+		float z = 1.0f - 2.0f * u.x;
+		float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		float phi = twoPi * u.y;
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	}
+
+	// Cosine-weighted direction around the normal, pdf = cos(theta) / pi
+	static glm::vec3 InUnitHemiSphere(const glm::vec3& normal, const glm::vec2& u)
 	{
-		return glm::normalize(RandomVec3(seed, -1, 1));
+		glm::vec2 d = ConcentricSampleDisk(u);
+		float z = std::sqrt(std::max(0.0f, 1.0f - d.x * d.x - d.y * d.y));
+		return ToWorld(normal, glm::vec3(d.x, d.y, z));
 	}
 
-	static glm::vec3 InUnitHemiSphere(uint32_t& seed)
+	// Equirectangular coordinates of a unit direction, u around +Y and v from the bottom pole
+	static glm::vec2 SphereUV(const glm::vec3& n)
 	{
-		return glm::normalize(glm::vec3(RandomFloat(seed, -1, 1), RandomFloat(seed, 0, 1), RandomFloat(seed, -1, 1)));
+		constexpr float invTwoPi = 0.15915494309f;
+		constexpr float invPi = 0.31830988618f;
+		return glm::vec2(0.5f + std::atan2(n.z, n.x) * invTwoPi, 0.5f + std::asin(glm::clamp(n.y, -1.0f, 1.0f)) * invPi);
 	}
 }
\ No newline at end of file
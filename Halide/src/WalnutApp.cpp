@@ -6,6 +6,7 @@
 
 #include "Renderer.h"
 #include "Camera.h"
+#include "Scenes.h"
 
 #include "glm/gtc/type_ptr.hpp"
 
@@ -19,42 +20,7 @@ public:
 	ExampleLayer()
 		: m_Camera(45.0f, 0.1f, 100.0f) 
 	{
-		m_Scene.SkyLight = glm::vec3{ 0.6f, 0.7f, 0.9f };
-
-		Light* not_skyLight = new Light(glm::vec3{ -1.0f, -1.0f,-1.0f }, glm::vec3{ 0.6f, 0.7f, 0.9f });
-		m_Scene.Lights.emplace_back(not_skyLight);
-
-		Diffuse* material_ground = new Diffuse(glm::vec3{ 0.8f, 0.8f, 0.0f });
-		m_Scene.Materials.emplace_back(material_ground);
-
-		Diffuse* material_center = new Diffuse(glm::vec3{ 0.1f, 0.2f, 0.5f });
-		m_Scene.Materials.emplace_back(material_center);
-
-		Metal* material_left = new Metal(glm::vec3{ 0.8f, 0.8f, 0.8f },0.0f);
-		m_Scene.Materials.emplace_back(material_left);
-
-		Metal* material_right = new Metal(glm::vec3{ 0.8f, 0.6f, 0.2f }, 0.0f);
-		m_Scene.Materials.emplace_back(material_right);
-
-		{
-			Sphere* sphere = new Sphere({ 0.0f, -100.5f, -1.0f }, 100.0f, 0);
-			m_Scene.Spheres.push_back(sphere);
-		}
-
-		{
-			Sphere* sphere = new Sphere({ 0.0f, 0.0f, -1.2f }, 0.5f, 1);
-			m_Scene.Spheres.push_back(sphere);
-		}
-
-		{
-			Sphere* sphere = new Sphere({ -1.0f, 0.0f, -1.0f }, 0.5f, 2);
-			m_Scene.Spheres.push_back(sphere);
-		}
-
-		{
-			Sphere* sphere = new Sphere({ 1.0f, 0.0f, -1.0f }, 0.5f, 3);
-			m_Scene.Spheres.push_back(sphere);
-		}
+		Scenes::ThreeSpheres(m_Scene);
 	}
 
 	virtual void OnUpdate(float ts) override
@@ -73,6 +39,51 @@ public:
 		}
   
 		ImGui::Checkbox("Accumulate", &m_Renderer.GetSettings().Accumulate);
+		if (ImGui::Checkbox("Gamma", &m_Renderer.GetSettings().Gamma))
+			m_Renderer.ResetFrameIndex();
+		if (ImGui::SliderInt("Bounces", &m_Renderer.GetSettings().Bounces, 1, 32))
+			m_Renderer.ResetFrameIndex();
+		ImGui::Checkbox("Specialize Kernels", &m_Renderer.GetSettings().SpecializeKernels);
+		if (ImGui::Checkbox("Jitter AA", &m_Renderer.GetSettings().JitterAA))
+			m_Renderer.ResetFrameIndex();
+		if (m_Renderer.GetSettings().JitterAA && ImGui::SliderInt("Subpixel Positions", &m_Renderer.GetSettings().SubpixelPositions, 1, 16))
+			m_Renderer.ResetFrameIndex();
+		if (m_Scene.Environment && ImGui::Checkbox("Sample Environment", &m_Renderer.GetSettings().SampleEnvironment))
+			m_Renderer.ResetFrameIndex();
+		if (!m_Scene.Lights.empty() && ImGui::Checkbox("Distant Lights", &m_Renderer.GetSettings().DistantLights))
+			m_Renderer.ResetFrameIndex();
+		if (ImGui::Checkbox("Sample Lights", &m_Renderer.GetSettings().SampleLights))
+			m_Renderer.ResetFrameIndex();
+		if (m_Renderer.GetSettings().SampleLights && ImGui::Checkbox("Light BVH", &m_Renderer.GetSettings().UseLightBVH))
+			m_Renderer.ResetFrameIndex();
+		if (ImGui::Checkbox("Path Guiding", &m_Renderer.GetSettings().PathGuiding))
+			m_Renderer.ResetFrameIndex();
+		if (const GuidingField* guiding = m_Renderer.GetGuidingField())
+			ImGui::Text("Guiding: pass %u, %.1f / %.1f MB", guiding->GetIteration(),
+				guiding->GetMemoryUsage() / 1048576.0, guiding->GetMemoryBudget() / 1048576.0);
+		ImGui::Checkbox("Cache First Hits", &m_Renderer.GetSettings().CacheFirstHits);
+		if (m_Renderer.GetSettings().CacheFirstHits)
+			ImGui::Text("First hits: %s, %.1f MB", m_Renderer.IsReplayingFirstHits() ? "cached" : "tracing",
+				m_Renderer.GetFirstHitCacheSize() / 1048576.0);
+		ImGui::Text("Kernel: %s", Renderer::GetKernelName(m_Renderer.GetActiveKernel()).c_str());
+
+		if (m_Scene.Textures.GetTextureCount() > 0)
+		{
+			TextureCache::Stats stats = m_Scene.Textures.GetStats();
+			ImGui::Text("Texture cache: %llu hits, %llu misses, %llu evictions", (unsigned long long)stats.Hits,
+				(unsigned long long)stats.Misses, (unsigned long long)stats.Evictions);
+			ImGui::Text("Texture memory: %.1f / %.1f MB", stats.MemoryUsed / 1048576.0, stats.MemoryBudget / 1048576.0);
+			if (ImGui::DragInt("Texture Budget (MB)", &m_TextureBudgetMB, 1.0f, 1, 16384))
+				m_Scene.Textures.SetMemoryBudget((size_t)m_TextureBudgetMB << 20);
+		}
+
+		const char* samplers[] = { "Random", "Sobol", "Blue Noise" };
+		int samplerIndex = (int)m_Renderer.GetSettings().Sampler;
+		if (ImGui::Combo("Sampler", &samplerIndex, samplers, IM_ARRAYSIZE(samplers)))
+		{
+			m_Renderer.GetSettings().Sampler = (SamplerType)samplerIndex;
+			m_Renderer.ResetFrameIndex();
+		}
 
 		if (ImGui::Button("Reset"))
 		{
@@ -82,16 +93,24 @@ public:
 
 		ImGui::Begin("Scene");
 		ImGui::Text("Lights");
-		ImGui::ColorEdit3("SkyLight Color", glm::value_ptr(m_Scene.SkyLight));
+		if (ImGui::Checkbox("Use SkyLight", &m_Scene.UseSkyLight))
+			m_Renderer.ResetFrameIndex();
+		if (m_Scene.UseSkyLight && ImGui::ColorEdit3("SkyLight Color", glm::value_ptr(m_Scene.SkyLight)))
+			m_Renderer.ResetFrameIndex();
 
 		for(size_t i =0; i<m_Scene.Spheres.size(); i++)
 		{
 			ImGui::PushID(i);
 			ImGui::Text("Object %d:", i);
 			Sphere* sphere = m_Scene.Spheres[i];
-			Material* material = m_Scene.Materials[i];
-			ImGui::DragFloat3("Position", glm::value_ptr(sphere->Position), 0.01f);
-			ImGui::DragFloat("Radius", &sphere->Radius, 0.01f);
+			Material* material = m_Scene.Materials[sphere->MaterialIndex];
+			bool moved = ImGui::DragFloat3("Position", glm::value_ptr(sphere->Position), 0.01f);
+			moved |= ImGui::DragFloat("Radius", &sphere->Radius, 0.01f);
+			if (moved)
+			{
+				m_Scene.MarkEdited();
+				m_Renderer.ResetFrameIndex();
+			}
 			// ImGui::DragInt("MatIndex", &sphere.MaterialIndex, 1.0f, 0, (int)m_Scene.Materials.size() - 1);
 			ImGui::ColorEdit3("Albedo", glm::value_ptr(material->Albedo));
 			switch (material->matType) {
@@ -109,8 +128,13 @@ public:
 				break;
 				case materialType::EmissiveMat:
 					ImGui::Text("Emissive");
-					ImGui::ColorEdit3("Emission Color", glm::value_ptr(static_cast<Emissive*>(material)->EmissiveColor), 0.01f);
-					ImGui::DragFloat("Emission Power", &static_cast<Emissive*>(material)->EmissivePower, 0.05f, 0.0f, FLT_MAX);
+					// Emission feeds the light BVH, which is rebuilt on scene edits
+					if (ImGui::ColorEdit3("Emission Color", glm::value_ptr(static_cast<Emissive*>(material)->EmissiveColor), 0.01f) |
+						ImGui::DragFloat("Emission Power", &static_cast<Emissive*>(material)->EmissivePower, 0.05f, 0.0f, FLT_MAX))
+					{
+						m_Scene.MarkEdited();
+						m_Renderer.ResetFrameIndex();
+					}
 				break;
 				case materialType::None:
 				break;
@@ -122,6 +146,48 @@ public:
 			ImGui::PopID();
 		}
 
+		// Analytic primitives, geometry only; their materials are shared with the spheres above
+		bool edited = false;
+		for (size_t i = 0; i < m_Scene.Planes.size(); i++)
+		{
+			ImGui::PushID(("plane" + std::to_string(i)).c_str());
+			ImGui::Text("Plane %d:", (int)i);
+			Plane& plane = m_Scene.Planes[i];
+			edited |= ImGui::DragFloat3("Point", glm::value_ptr(plane.Point), 0.01f);
+			if (ImGui::DragFloat3("Normal", glm::value_ptr(plane.Normal), 0.01f))
+			{
+				plane.Normal = glm::normalize(plane.Normal);
+				edited = true;
+			}
+			ImGui::Separator();
+			ImGui::PopID();
+		}
+		for (size_t i = 0; i < m_Scene.Boxes.size(); i++)
+		{
+			ImGui::PushID(("box" + std::to_string(i)).c_str());
+			ImGui::Text("Box %d:", (int)i);
+			Box& box = m_Scene.Boxes[i];
+			edited |= ImGui::DragFloat3("Min", glm::value_ptr(box.Min), 0.01f);
+			edited |= ImGui::DragFloat3("Max", glm::value_ptr(box.Max), 0.01f);
+			ImGui::Separator();
+			ImGui::PopID();
+		}
+		for (size_t i = 0; i < m_Scene.Discs.size(); i++)
+		{
+			ImGui::PushID(("disc" + std::to_string(i)).c_str());
+			ImGui::Text("Disc %d:", (int)i);
+			Disc& disc = m_Scene.Discs[i];
+			edited |= ImGui::DragFloat3("Center", glm::value_ptr(disc.Center), 0.01f);
+			edited |= ImGui::DragFloat("Radius", &disc.Radius, 0.01f, 0.0f, FLT_MAX);
+			ImGui::Separator();
+			ImGui::PopID();
+		}
+		if (edited)
+		{
+			m_Scene.MarkEdited();
+			m_Renderer.ResetFrameIndex();
+		}
+
 			ImGui::End();
 
 		ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
@@ -159,6 +225,7 @@ private:
 	uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
 
 	float m_LastRenderTime = 0.0f;
+	int m_TextureBudgetMB = 256;
 };
 
 Walnut::Application* Walnut::CreateApplication(int argc, char** argv)
@@ -0,0 +1,47 @@
+project "HalideBatch"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   staticruntime "off"
+
+   -- Headless batch renderer, same core as HalideBench
+   files
+   {
+      "src/**.h",
+      "src/**.cpp",
+      "../Halide/src/**.h",
+      "../Halide/src/**.cpp",
+   }
+   removefiles { "../Halide/src/WalnutApp.cpp" }
+
+   includedirs
+   {
+      "../Halide/src",
+      "../Walnut/vendor/glm",
+   }
+
+   defines { "HALIDE_HEADLESS" }
+
+   targetdir ("../bin/" .. outputdir .. "/%{prj.name}")
+   objdir ("../bin-int/" .. outputdir .. "/%{prj.name}")
+
+   filter "system:windows"
+      systemversion "latest"
+
+   filter "system:linux"
+      -- std::execution::par is backed by TBB in libstdc++
+      links { "tbb", "pthread" }
+
+   filter "configurations:Debug"
+      runtime "Debug"
+      symbols "On"
+
+   filter "configurations:Release"
+      runtime "Release"
+      optimize "On"
+      symbols "On"
+
+   filter "configurations:Dist"
+      runtime "Release"
+      optimize "On"
+      symbols "Off"
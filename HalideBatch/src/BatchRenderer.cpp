@@ -0,0 +1,389 @@
+// Batch renderer.
+//
+// Runs a stream of render jobs against one resident Scene, Renderer and Camera, so that
+// consecutive frames reuse the built acceleration structures, the texture cache, the frame
+// buffers and the worker threads of the parallel algorithms. Finished frames are handed to
+// a FrameWriter and encoded while the next frame renders.
+//
+// Jobs are lines of commands, from a file or a local socket:
+//
+//   scene <name>                        switch scene, rebuilt only when the name changes
+//   environment <path> [intensity]      light the scene with an equirectangular HDR PFM
+//   size <width> <height>               output resolution
+//   samples <n>                         samples per pixel
+//   sampler <random|sobol|bluenoise>
+//   key <px> <py> <pz> <fx> <fy> <fz>   append a camera keyframe (position, forward), the
+//                                       forward must not be vertical
+//   clear                               drop all keyframes
+//   render <frames> <path>              render frames along the keyframes; the path holds
+//                                       one frame number (%d or %04d) when frames > 1,
+//                                       %% is a literal '%', .pfm is linear
+//   shutdown                            stop serving a socket
+//
+// Settings and keyframes persist across jobs. Blank lines and lines starting with '#' are
+// skipped.
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "Scenes.h"
+
+#include "FrameWriter.h"
+#include "JobInput.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Keyframe
+{
+	glm::vec3 Position;
+	glm::vec3 Forward;
+};
+
+struct BatchState
+{
+	std::string SceneName;
+	std::unique_ptr<Scene> ActiveScene;
+
+	uint32_t Width = 640, Height = 360;
+	uint32_t Samples = 64;
+	SamplerType Sampler = SamplerType::Sobol;
+	std::vector<Keyframe> Keys;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static float SecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<float>(Clock::now() - start).count();
+}
+
+// Piecewise-linear camera path, keys are spaced evenly over t in [0, 1]
+static Keyframe EvaluatePath(const std::vector<Keyframe>& keys, float t)
+{
+	if (keys.empty())
+		return { glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+	if (keys.size() == 1)
+		return keys[0];
+
+	float position = glm::clamp(t, 0.0f, 1.0f) * (float)(keys.size() - 1);
+	size_t index = std::min((size_t)position, keys.size() - 2);
+	float blend = position - (float)index;
+
+	const Keyframe& a = keys[index];
+	const Keyframe& b = keys[index + 1];
+	Keyframe key;
+	key.Position = glm::mix(a.Position, b.Position, blend);
+	key.Forward = glm::mix(glm::normalize(a.Forward), glm::normalize(b.Forward), blend);
+	// Valid keys can still blend to a vertical or zero forward, e.g. one tilted up on either side
+	if (!Camera::IsValidForward(key.Forward))
+		key.Forward = b.Forward;
+	return key;
+}
+
+// Output path split around its frame number token. The pattern is user input, so it is
+// parsed here instead of being handed to printf as a format.
+struct FramePattern
+{
+	std::string Prefix, Suffix;
+	uint32_t Width = 0; // Zero-padded digits, 0 for plain %d
+	bool HasNumber = false;
+};
+
+// Accepts at most one %d or %0<N>d token; %% is a literal '%', any other '%' is an error
+static bool ParseFramePattern(const std::string& pattern, FramePattern& result, std::string& error)
+{
+	result = FramePattern();
+	std::string* out = &result.Prefix;
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		if (pattern[i] != '%')
+		{
+			*out += pattern[i];
+			continue;
+		}
+
+		if (i + 1 < pattern.size() && pattern[i + 1] == '%')
+		{
+			*out += '%';
+			i++;
+			continue;
+		}
+
+		size_t end = i + 1;
+		uint32_t width = 0;
+		if (end < pattern.size() && pattern[end] == '0')
+		{
+			end++;
+			size_t digits = end;
+			while (end < pattern.size() && std::isdigit((unsigned char)pattern[end]) && end - digits < 2)
+				width = width * 10 + (uint32_t)(pattern[end++] - '0');
+			if (end == digits || width == 0)
+			{
+				error = "bad frame number in '" + pattern + "', expected %d or %0<N>d";
+				return false;
+			}
+		}
+		if (end >= pattern.size() || pattern[end] != 'd')
+		{
+			error = "bad frame number in '" + pattern + "', expected %d or %0<N>d";
+			return false;
+		}
+		if (result.HasNumber)
+		{
+			error = "more than one frame number in '" + pattern + "'";
+			return false;
+		}
+
+		result.HasNumber = true;
+		result.Width = width;
+		out = &result.Suffix;
+		i = end;
+	}
+	return true;
+}
+
+static std::string FramePath(const FramePattern& pattern, uint32_t frame)
+{
+	if (!pattern.HasNumber)
+		return pattern.Prefix;
+
+	std::string number = std::to_string(frame);
+	if (number.size() < pattern.Width)
+		number.insert(0, pattern.Width - number.size(), '0');
+	return pattern.Prefix + number + pattern.Suffix;
+}
+
+static bool ParseSampler(const std::string& name, SamplerType& sampler)
+{
+	if (name == "random")
+		sampler = SamplerType::Random;
+	else if (name == "sobol")
+		sampler = SamplerType::Sobol;
+	else if (name == "bluenoise")
+		sampler = SamplerType::BlueNoise;
+	else
+		return false;
+	return true;
+}
+
+static std::string RenderJob(BatchState& state, uint32_t frames, const FramePattern& pattern,
+	Renderer& renderer, Camera& camera, FrameWriter& writer)
+{
+	if (!state.ActiveScene)
+		return "error: no scene";
+
+	// Both only reallocate when the resolution changes between jobs
+	camera.OnResize(state.Width, state.Height);
+	renderer.OnResize(state.Width, state.Height);
+
+	Renderer::Settings& settings = renderer.GetSettings();
+	settings.Accumulate = true;
+	settings.Gamma = false; // The writer encodes, PFM output stays linear
+	settings.Sampler = state.Sampler;
+
+	Clock::time_point jobStart = Clock::now();
+	float stallStart = writer.GetStallSeconds();
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		float t = frames > 1 ? (float)frame / (float)(frames - 1) : 0.0f;
+		Keyframe key = EvaluatePath(state.Keys, t);
+		camera.SetView(key.Position, key.Forward);
+
+		renderer.ResetFrameIndex();
+		for (uint32_t i = 0; i < state.Samples; i++)
+			renderer.Render(*state.ActiveScene, camera);
+
+		FrameWriter::Frame output = writer.AcquireFrame();
+		output.Path = FramePath(pattern, frame);
+		output.Width = state.Width;
+		output.Height = state.Height;
+		output.Samples = renderer.GetSampleCount();
+		const glm::vec4* accumulation = renderer.GetAccumulationData();
+		output.Accumulation.assign(accumulation, accumulation + (size_t)state.Width * state.Height);
+		writer.Submit(std::move(output));
+	}
+
+	std::vector<std::string> failures = writer.Flush();
+	float seconds = SecondsSince(jobStart);
+	printf("  %u frames in %.2fs (%.2fs/frame, %.2fs waiting on the writer)\n", frames, seconds,
+		seconds / (float)frames, writer.GetStallSeconds() - stallStart);
+
+	if (!failures.empty())
+		return "error: could not write " + failures.front() + (failures.size() > 1 ? " and " + std::to_string(failures.size() - 1) + " more" : "");
+	return "done " + std::to_string(frames);
+}
+
+// Returns the status line for the command, empty for lines without a reply
+static std::string Execute(const std::string& line, BatchState& state, Renderer& renderer, Camera& camera, FrameWriter& writer, bool& shutdown)
+{
+	std::istringstream stream(line);
+	std::string command;
+	if (!(stream >> command) || command[0] == '#')
+		return "";
+
+	if (command == "scene")
+	{
+		std::string name;
+		stream >> name;
+		Scenes::BuildFn build = Scenes::Find(name);
+		if (!build)
+			return "error: unknown scene '" + name + "'";
+
+		if (name != state.SceneName)
+		{
+			Clock::time_point start = Clock::now();
+			state.ActiveScene = std::make_unique<Scene>();
+			build(*state.ActiveScene);
+			state.SceneName = name;
+			printf("  built %s in %.2fs\n", name.c_str(), SecondsSince(start));
+		}
+		return "ok";
+	}
+	if (command == "environment")
+	{
+		std::string path;
+		float intensity = 1.0f;
+		if (!(stream >> path))
+			return "error: environment <path> [intensity]";
+		stream >> intensity;
+		if (!state.ActiveScene)
+			return "error: no scene";
+
+		std::unique_ptr<EnvironmentMap> environment = EnvironmentMap::LoadPFM(path);
+		if (!environment)
+			return "error: could not read " + path;
+		environment->Intensity = intensity;
+		state.ActiveScene->Environment = std::move(environment);
+		return "ok";
+	}
+	if (command == "size")
+	{
+		uint32_t width = 0, height = 0;
+		if (!(stream >> width >> height) || width == 0 || height == 0)
+			return "error: size <width> <height>";
+		state.Width = width;
+		state.Height = height;
+		return "ok";
+	}
+	if (command == "samples")
+	{
+		uint32_t samples = 0;
+		if (!(stream >> samples) || samples == 0)
+			return "error: samples <n>";
+		state.Samples = samples;
+		return "ok";
+	}
+	if (command == "sampler")
+	{
+		std::string name;
+		stream >> name;
+		if (!ParseSampler(name, state.Sampler))
+			return "error: unknown sampler '" + name + "'";
+		return "ok";
+	}
+	if (command == "key")
+	{
+		Keyframe key;
+		if (!(stream >> key.Position.x >> key.Position.y >> key.Position.z >> key.Forward.x >> key.Forward.y >> key.Forward.z))
+			return "error: key <px> <py> <pz> <fx> <fy> <fz>";
+		if (!Camera::IsValidForward(key.Forward))
+			return "error: key forward must be nonzero and not point straight up or down";
+		state.Keys.push_back(key);
+		return "ok";
+	}
+	if (command == "clear")
+	{
+		state.Keys.clear();
+		return "ok";
+	}
+	if (command == "render")
+	{
+		uint32_t frames = 0;
+		std::string pattern;
+		if (!(stream >> frames >> pattern) || frames == 0)
+			return "error: render <frames> <path>";
+
+		FramePattern framePattern;
+		std::string error;
+		if (!ParseFramePattern(pattern, framePattern, error))
+			return "error: " + error;
+		// Every frame would overwrite the previous one
+		if (frames > 1 && !framePattern.HasNumber)
+			return "error: rendering " + std::to_string(frames) + " frames needs a frame number (%d or %0<N>d) in the path";
+
+		printf("render %u x %s (%ux%u, %u spp)\n", frames, pattern.c_str(), state.Width, state.Height, state.Samples);
+		return RenderJob(state, frames, framePattern, renderer, camera, writer);
+	}
+	if (command == "shutdown")
+	{
+		shutdown = true;
+		return "ok";
+	}
+	return "error: unknown command '" + command + "'";
+}
+
+static void PrintUsage()
+{
+	printf(
+		"usage: HalideBatch <jobs-file | - | --socket <path>>\n"
+		"  <jobs-file>        run the commands in a file, '-' reads stdin\n"
+		"  --socket <path>    serve commands on a Unix domain socket until 'shutdown'\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::unique_ptr<JobInput> input;
+	if (argc == 3 && std::string(argv[1]) == "--socket")
+	{
+		input = JobInput::OpenSocket(argv[2]);
+		if (!input)
+		{
+			fprintf(stderr, "error: could not listen on %s\n", argv[2]);
+			return 2;
+		}
+	}
+	else if (argc == 2)
+	{
+		input = JobInput::OpenFile(argv[1]);
+		if (!input)
+		{
+			fprintf(stderr, "error: could not open %s\n", argv[1]);
+			return 2;
+		}
+	}
+	else
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	BatchState state;
+	Renderer renderer;
+	Camera camera(45.0f, 0.1f, 100.0f);
+	FrameWriter writer;
+
+	bool failed = false, shutdown = false;
+	std::string line;
+	while (!shutdown && input->ReadLine(line))
+	{
+		std::string status = Execute(line, state, renderer, camera, writer, shutdown);
+		if (status.empty())
+			continue;
+
+		if (status.compare(0, 5, "error") == 0)
+		{
+			fprintf(stderr, "%s\n", status.c_str());
+			failed = true;
+		}
+		input->Reply(status);
+	}
+
+	return failed ? 1 : 0;
+}
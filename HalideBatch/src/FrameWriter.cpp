@@ -0,0 +1,110 @@
+#include "FrameWriter.h"
+
+#include "ImageIO.h"
+
+#include <chrono>
+#include <cmath>
+
+FrameWriter::FrameWriter(uint32_t maxPending)
+	: m_MaxPending(maxPending > 0 ? maxPending : 1)
+{
+	m_Worker = std::thread(&FrameWriter::WorkerLoop, this);
+}
+
+FrameWriter::~FrameWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_WorkAvailable.notify_one();
+	m_Worker.join();
+}
+
+FrameWriter::Frame FrameWriter::AcquireFrame()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (m_InFlight >= m_MaxPending)
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_FrameWritten.wait(lock, [this] { return m_InFlight < m_MaxPending; });
+		m_StallSeconds += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	}
+	m_InFlight++;
+
+	if (m_FreeFrames.empty())
+		return Frame();
+
+	Frame frame = std::move(m_FreeFrames.back());
+	m_FreeFrames.pop_back();
+	return frame;
+}
+
+void FrameWriter::Submit(Frame&& frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Queue.push_back(std::move(frame));
+	}
+	m_WorkAvailable.notify_one();
+}
+
+std::vector<std::string> FrameWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_FrameWritten.wait(lock, [this] { return m_Queue.empty() && m_InFlight == 0; });
+	return std::move(m_Failures);
+}
+
+void FrameWriter::WorkerLoop()
+{
+	std::vector<float> scratch;
+	while (true)
+	{
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WorkAvailable.wait(lock, [this] { return m_Stopping || !m_Queue.empty(); });
+			if (m_Queue.empty())
+				return;
+
+			frame = std::move(m_Queue.front());
+			m_Queue.pop_front();
+		}
+
+		bool written = Encode(frame, scratch);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!written)
+				m_Failures.push_back(frame.Path);
+			m_FreeFrames.push_back(std::move(frame));
+			m_InFlight--;
+		}
+		m_FrameWritten.notify_all();
+	}
+}
+
+bool FrameWriter::Encode(const Frame& frame, std::vector<float>& scratch)
+{
+	bool linear = frame.Path.size() >= 4 && frame.Path.compare(frame.Path.size() - 4, 4, ".pfm") == 0;
+	float invSamples = 1.0f / (float)frame.Samples;
+
+	size_t pixelCount = (size_t)frame.Width * frame.Height;
+	scratch.resize(pixelCount * 3);
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		glm::vec3 color = glm::vec3(frame.Accumulation[i]) * invSamples;
+		// Same gamma 2 curve as the viewer, applied to the mean rather than per sample
+		if (!linear)
+			color = glm::sqrt(glm::max(color, glm::vec3(0.0f)));
+
+		scratch[i * 3 + 0] = color.r;
+		scratch[i * 3 + 1] = color.g;
+		scratch[i * 3 + 2] = color.b;
+	}
+
+	if (linear)
+		return ImageIO::WritePFM(frame.Path, frame.Width, frame.Height, scratch);
+	return ImageIO::WritePPM(frame.Path, frame.Width, frame.Height, scratch);
+}
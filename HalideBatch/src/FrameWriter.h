@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encodes and writes finished frames on a background thread, so the next frame renders
+// while the previous one goes to disk. Frame buffers are recycled: once the writer is
+// MaxPending frames behind, AcquireFrame blocks until one is written.
+class FrameWriter
+{
+public:
+	struct Frame
+	{
+		std::string Path;       // .pfm is written linear, anything else as gamma-encoded PPM
+		uint32_t Width = 0, Height = 0;
+		uint32_t Samples = 1;
+		std::vector<glm::vec4> Accumulation; // Sum over Samples, as the renderer keeps it
+	};
+
+	FrameWriter(uint32_t maxPending = 2);
+	~FrameWriter();
+
+	FrameWriter(const FrameWriter&) = delete;
+	FrameWriter& operator=(const FrameWriter&) = delete;
+
+	Frame AcquireFrame();
+	void Submit(Frame&& frame);
+
+	// Blocks until every submitted frame is written, returns the paths that failed since the last call
+	std::vector<std::string> Flush();
+
+	// Seconds the render thread spent blocked in AcquireFrame
+	float GetStallSeconds() const { return m_StallSeconds; }
+
+private:
+	void WorkerLoop();
+	static bool Encode(const Frame& frame, std::vector<float>& scratch);
+
+private:
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkAvailable, m_FrameWritten;
+
+	std::deque<Frame> m_Queue;
+	std::vector<Frame> m_FreeFrames;
+	std::vector<std::string> m_Failures;
+	uint32_t m_MaxPending;
+	uint32_t m_InFlight = 0; // Acquired or queued, not yet written
+	bool m_Stopping = false;
+
+	float m_StallSeconds = 0.0f;
+};
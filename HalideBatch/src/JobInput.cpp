@@ -0,0 +1,167 @@
+#include "JobInput.h"
+
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+class StreamJobInput : public JobInput
+{
+public:
+	StreamJobInput(const std::string& path)
+	{
+		if (path != "-")
+			m_File.open(path);
+	}
+
+	bool IsOpen() const { return !m_File.is_open() || m_File.good(); }
+
+	bool ReadLine(std::string& line) override
+	{
+		std::istream& stream = m_File.is_open() ? (std::istream&)m_File : std::cin;
+		return (bool)std::getline(stream, line);
+	}
+private:
+	std::ifstream m_File;
+};
+
+std::unique_ptr<JobInput> JobInput::OpenFile(const std::string& path)
+{
+	auto input = std::make_unique<StreamJobInput>(path);
+	if (path != "-" && !input->IsOpen())
+		return nullptr;
+	return input;
+}
+
+#ifndef _WIN32
+
+// Replies to a client that hung up must not raise SIGPIPE and end the process. Linux has a
+// send flag for that; macOS and the BSDs set SO_NOSIGPIPE on the socket instead.
+#ifdef MSG_NOSIGNAL
+static constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+static constexpr int SendFlags = 0;
+#endif
+
+class SocketJobInput : public JobInput
+{
+public:
+	~SocketJobInput() override
+	{
+		if (m_Client >= 0)
+			close(m_Client);
+		if (m_Listener >= 0)
+		{
+			close(m_Listener);
+			unlink(m_Path.c_str());
+		}
+	}
+
+	bool Listen(const std::string& path)
+	{
+		sockaddr_un address = {};
+		if (path.size() >= sizeof(address.sun_path))
+			return false;
+
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+		// A stale socket file from a previous run would make bind fail
+		unlink(path.c_str());
+
+		m_Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (m_Listener < 0)
+			return false;
+		if (bind(m_Listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(m_Listener, 4) != 0)
+		{
+			close(m_Listener);
+			m_Listener = -1;
+			return false;
+		}
+		m_Path = path;
+		return true;
+	}
+
+	bool ReadLine(std::string& line) override
+	{
+		while (true)
+		{
+			size_t newline = m_Buffer.find('\n');
+			if (newline != std::string::npos)
+			{
+				line = m_Buffer.substr(0, newline);
+				m_Buffer.erase(0, newline + 1);
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				return true;
+			}
+
+			if (m_Client < 0)
+			{
+				m_Client = accept(m_Listener, nullptr, nullptr);
+				if (m_Client < 0)
+					return false;
+#ifdef SO_NOSIGPIPE
+				int noSignal = 1;
+				setsockopt(m_Client, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+				m_Buffer.clear();
+				continue;
+			}
+
+			char chunk[4096];
+			ssize_t received = recv(m_Client, chunk, sizeof(chunk), 0);
+			if (received <= 0)
+			{
+				// Client went away, a trailing line without newline still counts
+				close(m_Client);
+				m_Client = -1;
+				if (!m_Buffer.empty())
+				{
+					line = std::move(m_Buffer);
+					m_Buffer.clear();
+					return true;
+				}
+				continue;
+			}
+			m_Buffer.append(chunk, (size_t)received);
+		}
+	}
+
+	void Reply(const std::string& message) override
+	{
+		if (m_Client < 0)
+			return;
+
+		std::string data = message + "\n";
+		// Best effort, a client that stopped reading must not take the renderer down
+		send(m_Client, data.data(), data.size(), SendFlags);
+	}
+private:
+	std::string m_Path;
+	int m_Listener = -1;
+	int m_Client = -1;
+	std::string m_Buffer;
+};
+
+std::unique_ptr<JobInput> JobInput::OpenSocket(const std::string& path)
+{
+	auto input = std::make_unique<SocketJobInput>();
+	if (!input->Listen(path))
+		return nullptr;
+	return input;
+}
+
+#else
+
+std::unique_ptr<JobInput> JobInput::OpenSocket(const std::string& /*path*/)
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+// Line-oriented source of batch commands: a job file, stdin, or clients of a local socket.
+// Commands run as their lines arrive, so a socket client can queue work while frames render.
+class JobInput
+{
+public:
+	virtual ~JobInput() = default;
+
+	// Next line without the newline, false once the input is exhausted
+	virtual bool ReadLine(std::string& line) = 0;
+	// Status line back to whoever sent the command, ignored for files
+	virtual void Reply(const std::string& /*message*/) {}
+
+	// "-" reads stdin
+	static std::unique_ptr<JobInput> OpenFile(const std::string& path);
+	// Listens on a Unix domain socket and serves one client at a time, until "shutdown".
+	// Returns nullptr where local sockets are not supported.
+	static std::unique_ptr<JobInput> OpenSocket(const std::string& path);
+};
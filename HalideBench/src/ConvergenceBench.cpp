@@ -0,0 +1,444 @@
+// Convergence-per-second harness.
+//
+// Renders every bench scene to a high-sample reference once, then renders it again under a
+// wall-clock budget and records RMSE / relMSE against the reference over time. Monte Carlo
+// error falls as 1/t, so relMSE * seconds is roughly constant per scene: that product is the
+// efficiency we track, lower is better. The run fails when a scene gets worse than the stored
+// baseline by more than the tolerance, or has no baseline at all: efficiency depends on the
+// machine, so a missing baseline must not pass silently.
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "Scenes.h"
+#include "ImageIO.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchScene
+{
+	const char* Name;
+	void (*Build)(Scene&);
+	glm::vec3 CameraPosition;
+	glm::vec3 CameraForward;
+};
+
+static const BenchScene s_BenchScenes[] = {
+	{ "three_spheres",   Scenes::ThreeSpheres,   { 0.0f, 0.0f, 6.0f }, { 0.0f, 0.0f, -1.0f } },
+	{ "rough_metals",    Scenes::RoughMetals,    { 0.0f, 0.0f, 6.0f }, { 0.0f, 0.0f, -1.0f } },
+	{ "sphere_grid",     Scenes::SphereGrid,     { 0.0f, 1.5f, 3.0f }, { 0.0f, -0.4f, -1.0f } },
+	{ "instanced_field", Scenes::InstancedField, { 0.0f, 2.0f, 2.0f }, { 0.0f, -0.3f, -1.0f } },
+	{ "textured",        Scenes::TexturedSpheres, { 0.0f, 0.0f, 6.0f }, { 0.0f, 0.0f, -1.0f } },
+	{ "sunlit",          Scenes::SunlitSpheres, { 0.0f, 0.0f, 6.0f }, { 0.0f, 0.0f, -1.0f } },
+	{ "primitives",      Scenes::Primitives,    { 0.0f, 1.0f, 3.0f }, { 0.0f, -0.3f, -1.0f } },
+	{ "light_gap",       Scenes::LightThroughGap, { 0.0f, 1.0f, 0.2f }, { 0.0f, -0.1f, -1.0f } },
+	{ "many_lights",     Scenes::ManyLights,    { 0.0f, 1.5f, 3.0f }, { 0.0f, -0.4f, -1.0f } },
+};
+
+struct BenchOptions
+{
+	std::string DataDirectory = "bench-data";
+	std::string SceneFilter;
+	uint32_t Width = 320, Height = 180;
+	uint32_t ReferenceSamples = 1024;
+	float BudgetSeconds = 10.0f;
+	float Tolerance = 0.1f;
+	SamplerType Sampler = SamplerType::Sobol;
+	bool UpdateReference = false;
+	bool UpdateBaseline = false;
+	bool Kernels = false;
+	bool Guiding = false;
+};
+
+struct CurvePoint
+{
+	float Seconds;
+	uint32_t Samples;
+	float RMSE;
+	float RelMSE;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static float SecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<float>(Clock::now() - start).count();
+}
+
+static std::vector<float> ResolveEstimate(const Renderer& renderer)
+{
+	const glm::vec4* accumulation = renderer.GetAccumulationData();
+	float invSamples = 1.0f / (float)renderer.GetSampleCount();
+
+	size_t pixelCount = (size_t)renderer.GetWidth() * renderer.GetHeight();
+	std::vector<float> rgb(pixelCount * 3);
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		rgb[i * 3 + 0] = accumulation[i].r * invSamples;
+		rgb[i * 3 + 1] = accumulation[i].g * invSamples;
+		rgb[i * 3 + 2] = accumulation[i].b * invSamples;
+	}
+	return rgb;
+}
+
+static void ComputeError(const std::vector<float>& image, const std::vector<float>& reference, float& rmse, float& relMse)
+{
+	double squared = 0.0, relative = 0.0;
+	for (size_t i = 0; i < image.size(); i++)
+	{
+		double diff = (double)image[i] - (double)reference[i];
+		squared += diff * diff;
+		relative += diff * diff / ((double)reference[i] * reference[i] + 1e-2);
+	}
+	rmse = (float)std::sqrt(squared / (double)image.size());
+	relMse = (float)(relative / (double)image.size());
+}
+
+static void SetupRenderer(Renderer& renderer, Camera& camera, const BenchScene& benchScene, const BenchOptions& options, SamplerType sampler)
+{
+	camera.SetView(benchScene.CameraPosition, benchScene.CameraForward);
+	camera.OnResize(options.Width, options.Height);
+
+	renderer.GetSettings().Accumulate = true;
+	// Error is measured on radiance, gamma-encoding each sample would converge to E[gamma(L)]
+	renderer.GetSettings().Gamma = false;
+	renderer.GetSettings().Sampler = sampler;
+	renderer.OnResize(options.Width, options.Height);
+	renderer.ResetFrameIndex();
+}
+
+// Independent samples from a disjoint index range, the reference must not share structure or
+// sample values with the run under test
+static void SetupReferenceRenderer(Renderer& renderer, Camera& camera, const BenchScene& benchScene, const BenchOptions& options)
+{
+	SetupRenderer(renderer, camera, benchScene, options, SamplerType::Random);
+	renderer.GetSettings().SampleIndexOffset = 1u << 31;
+}
+
+// Identifies what a reference was rendered from: the hashed first sample of the reference's
+// sample range plus its sample count. Changes to the scene, or to how the renderer lights it,
+// change that sample too, so stale references are rebuilt instead of compared against.
+static uint64_t ReferenceKey(const BenchScene& benchScene, const Scene& scene, const BenchOptions& options)
+{
+	Renderer renderer;
+	Camera camera(45.0f, 0.1f, 100.0f);
+	SetupReferenceRenderer(renderer, camera, benchScene, options);
+	renderer.Render(scene, camera);
+	std::vector<float> sample = ResolveEstimate(renderer);
+
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ull;
+	};
+	add(sample.data(), sample.size() * sizeof(float));
+	add(&options.ReferenceSamples, sizeof(options.ReferenceSamples));
+	return hash;
+}
+
+static bool LoadOrRenderReference(const BenchScene& benchScene, const Scene& scene, const BenchOptions& options, std::vector<float>& reference)
+{
+	std::string path = options.DataDirectory + "/" + benchScene.Name + ".ref.pfm";
+	std::string keyPath = options.DataDirectory + "/" + benchScene.Name + ".ref.key";
+	uint64_t key = ReferenceKey(benchScene, scene, options);
+
+	// Rows are bottom to top in both the PFM and the renderer
+	uint32_t width = 0, height = 0;
+	uint64_t storedKey = 0;
+	bool keyMatches = (bool)(std::ifstream(keyPath) >> std::hex >> storedKey) && storedKey == key;
+	if (!options.UpdateReference && keyMatches && ImageIO::ReadPFM(path, width, height, reference) && width == options.Width && height == options.Height)
+		return true;
+
+	printf("  rendering reference (%u spp)...\n", options.ReferenceSamples);
+	Renderer renderer;
+	Camera camera(45.0f, 0.1f, 100.0f);
+	SetupReferenceRenderer(renderer, camera, benchScene, options);
+
+	Clock::time_point start = Clock::now();
+	for (uint32_t i = 0; i < options.ReferenceSamples; i++)
+		renderer.Render(scene, camera);
+	printf("  reference done in %.1fs\n", SecondsSince(start));
+
+	reference = ResolveEstimate(renderer);
+	if (!ImageIO::WritePFM(path, options.Width, options.Height, reference) || !(std::ofstream(keyPath) << std::hex << key << "\n"))
+	{
+		fprintf(stderr, "error: could not write %s\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::vector<CurvePoint> RunBudget(const BenchScene& benchScene, const Scene& scene, const BenchOptions& options, const std::vector<float>& reference)
+{
+	Renderer renderer;
+	Camera camera(45.0f, 0.1f, 100.0f);
+	SetupRenderer(renderer, camera, benchScene, options, options.Sampler);
+	// Training passes are part of the budget, like they are for an interactive session
+	renderer.GetSettings().PathGuiding = options.Guiding;
+
+	// Checkpoints on a geometric time schedule, error evaluation is not charged to the budget
+	std::vector<CurvePoint> curve;
+	float renderSeconds = 0.0f;
+	float nextCheckpoint = 0.05f;
+	while (renderSeconds < options.BudgetSeconds)
+	{
+		Clock::time_point frameStart = Clock::now();
+		renderer.Render(scene, camera);
+		renderSeconds += SecondsSince(frameStart);
+
+		if (renderSeconds < nextCheckpoint && renderSeconds < options.BudgetSeconds)
+			continue;
+
+		CurvePoint point;
+		point.Seconds = renderSeconds;
+		point.Samples = renderer.GetSampleCount();
+		ComputeError(ResolveEstimate(renderer), reference, point.RMSE, point.RelMSE);
+		curve.push_back(point);
+
+		nextCheckpoint = std::max(nextCheckpoint * 1.25f, renderSeconds);
+	}
+	return curve;
+}
+
+// relMSE * t over the second half of the curve, the median keeps timing hiccups out
+static float Efficiency(const std::vector<CurvePoint>& curve)
+{
+	std::vector<float> products;
+	for (size_t i = curve.size() / 2; i < curve.size(); i++)
+		products.push_back(curve[i].RelMSE * curve[i].Seconds);
+	if (products.empty())
+		return 0.0f;
+
+	std::nth_element(products.begin(), products.begin() + products.size() / 2, products.end());
+	return products[products.size() / 2];
+}
+
+static void WriteCurve(const std::string& path, const std::vector<CurvePoint>& curve)
+{
+	std::ofstream file(path);
+	file << "seconds,samples,rmse,relmse\n";
+	for (const CurvePoint& point : curve)
+		file << point.Seconds << "," << point.Samples << "," << point.RMSE << "," << point.RelMSE << "\n";
+}
+
+static std::map<std::string, float> ReadBaseline(const std::string& path)
+{
+	std::map<std::string, float> baseline;
+	std::ifstream file(path);
+	std::string name;
+	float value;
+	while (file >> name >> value)
+		baseline[name] = value;
+	return baseline;
+}
+
+static void WriteBaseline(const std::string& path, const std::map<std::string, float>& baseline)
+{
+	std::ofstream file(path);
+	for (const auto& [name, value] : baseline)
+		file << name << " " << value << "\n";
+}
+
+// Paths per second of one renderer configuration, frames rendered until the time is up
+static double MeasureThroughput(const BenchScene& benchScene, const Scene& scene, const BenchOptions& options, bool specialize, bool gamma, uint32_t& kernel)
+{
+	Renderer renderer;
+	Camera camera(45.0f, 0.1f, 100.0f);
+	SetupRenderer(renderer, camera, benchScene, options, options.Sampler);
+	renderer.GetSettings().SpecializeKernels = specialize;
+	renderer.GetSettings().Gamma = gamma;
+
+	// Warm-up frame, keeps sampler creation and first-touch page faults out of the timing
+	renderer.Render(scene, camera);
+
+	uint32_t frames = 0;
+	float seconds = 0.0f;
+	float duration = options.BudgetSeconds * 0.25f;
+	while (seconds < duration)
+	{
+		Clock::time_point frameStart = Clock::now();
+		renderer.Render(scene, camera);
+		seconds += SecondsSince(frameStart);
+		frames++;
+	}
+
+	kernel = renderer.GetActiveKernel();
+	return (double)frames * options.Width * options.Height / seconds;
+}
+
+// Specialized kernel against the all-features kernel, per scene and gamma setting
+static void RunKernelBench(const BenchOptions& options)
+{
+	printf("%-16s %-50s %12s %12s %8s\n", "scene", "kernel", "generic/s", "special/s", "gain");
+	for (const BenchScene& benchScene : s_BenchScenes)
+	{
+		if (!options.SceneFilter.empty() && options.SceneFilter != benchScene.Name)
+			continue;
+
+		Scene scene;
+		benchScene.Build(scene);
+		for (bool gamma : { true, false })
+		{
+			uint32_t genericKernel = 0, specialKernel = 0;
+			double generic = MeasureThroughput(benchScene, scene, options, false, gamma, genericKernel);
+			double special = MeasureThroughput(benchScene, scene, options, true, gamma, specialKernel);
+			printf("%-16s %-50s %12.0f %12.0f %7.1f%%\n", benchScene.Name, Renderer::GetKernelName(specialKernel).c_str(),
+				generic, special, (special / generic - 1.0) * 100.0);
+		}
+	}
+}
+
+static void PrintUsage()
+{
+	printf(
+		"usage: HalideBench [options]\n"
+		"  --data <dir>              references, curves and baseline (default bench-data)\n"
+		"  --scene <name>            only run this scene\n"
+		"  --size <width> <height>   render resolution (default 320 180)\n"
+		"  --budget <seconds>        wall-clock budget per scene (default 10)\n"
+		"  --reference-spp <n>       samples for missing or stale references (default 1024)\n"
+		"  --sampler <name>          random | sobol | bluenoise (default sobol)\n"
+		"  --tolerance <fraction>    allowed efficiency regression (default 0.1)\n"
+		"  --update-reference        re-render references\n"
+		"  --update-baseline         store this run as the new baseline\n"
+		"  --kernels                 paths/s of specialized vs generic kernels, budget / 4 each\n"
+		"  --guiding                 render with path guiding (references stay unguided)\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--data" && hasValue)
+			options.DataDirectory = argv[++i];
+		else if (arg == "--scene" && hasValue)
+			options.SceneFilter = argv[++i];
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			options.Width = (uint32_t)std::atoi(argv[++i]);
+			options.Height = (uint32_t)std::atoi(argv[++i]);
+		}
+		else if (arg == "--budget" && hasValue)
+			options.BudgetSeconds = (float)std::atof(argv[++i]);
+		else if (arg == "--reference-spp" && hasValue)
+			options.ReferenceSamples = (uint32_t)std::atoi(argv[++i]);
+		else if (arg == "--tolerance" && hasValue)
+			options.Tolerance = (float)std::atof(argv[++i]);
+		else if (arg == "--sampler" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "random")
+				options.Sampler = SamplerType::Random;
+			else if (name == "sobol")
+				options.Sampler = SamplerType::Sobol;
+			else if (name == "bluenoise")
+				options.Sampler = SamplerType::BlueNoise;
+			else
+				return false;
+		}
+		else if (arg == "--update-reference")
+			options.UpdateReference = true;
+		else if (arg == "--update-baseline")
+			options.UpdateBaseline = true;
+		else if (arg == "--kernels")
+			options.Kernels = true;
+		else if (arg == "--guiding")
+			options.Guiding = true;
+		else
+			return false;
+	}
+	return options.Width > 0 && options.Height > 0 && options.BudgetSeconds > 0.0f && options.ReferenceSamples > 0;
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	if (options.Kernels)
+	{
+		RunKernelBench(options);
+		return 0;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(options.DataDirectory, error);
+
+	std::string baselinePath = options.DataDirectory + "/baseline.txt";
+	std::map<std::string, float> baseline = ReadBaseline(baselinePath);
+	bool regressed = false, missingBaseline = false;
+
+	printf("%-16s %8s %10s %12s %12s %12s\n", "scene", "spp", "rmse", "relmse", "relmse*s", "baseline");
+	for (const BenchScene& benchScene : s_BenchScenes)
+	{
+		if (!options.SceneFilter.empty() && options.SceneFilter != benchScene.Name)
+			continue;
+
+		printf("%s\n", benchScene.Name);
+		Scene scene;
+		benchScene.Build(scene);
+
+		std::vector<float> reference;
+		if (!LoadOrRenderReference(benchScene, scene, options, reference))
+			return 2;
+
+		std::vector<CurvePoint> curve = RunBudget(benchScene, scene, options, reference);
+		WriteCurve(options.DataDirectory + "/" + benchScene.Name + ".curve.csv", curve);
+
+		float efficiency = Efficiency(curve);
+		const CurvePoint& last = curve.back();
+
+		auto it = baseline.find(benchScene.Name);
+		bool hasBaseline = it != baseline.end();
+		bool sceneRegressed = hasBaseline && efficiency > it->second * (1.0f + options.Tolerance);
+		char baselineText[32] = "-";
+		if (hasBaseline)
+			snprintf(baselineText, sizeof(baselineText), "%.4e", it->second);
+		printf("%-16s %8u %10.5f %12.4e %12.4e %12s%s\n", "", last.Samples, last.RMSE, last.RelMSE, efficiency,
+			baselineText, sceneRegressed ? "  REGRESSED" : "");
+
+		if (scene.Textures.GetTextureCount() > 0)
+		{
+			TextureCache::Stats stats = scene.Textures.GetStats();
+			printf("%-16s texture cache: %llu hits, %llu misses, %llu evictions, %.1f / %.1f MB\n", "",
+				(unsigned long long)stats.Hits, (unsigned long long)stats.Misses, (unsigned long long)stats.Evictions,
+				stats.MemoryUsed / 1048576.0, stats.MemoryBudget / 1048576.0);
+		}
+
+		if (options.UpdateBaseline)
+			baseline[benchScene.Name] = efficiency;
+		else
+		{
+			regressed |= sceneRegressed;
+			missingBaseline |= !hasBaseline;
+		}
+	}
+
+	if (options.UpdateBaseline)
+		WriteBaseline(baselinePath, baseline);
+
+	if (missingBaseline)
+	{
+		fprintf(stderr, "error: no baseline for some scenes in %s, record one on this machine with --update-baseline\n", baselinePath.c_str());
+		return 2;
+	}
+	return regressed ? 1 : 0;
+}
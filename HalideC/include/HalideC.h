@@ -0,0 +1,205 @@
+/*
+ * HalideC: C interface to the Halide renderer, for embedding it in other pipelines.
+ *
+ * An instance owns a scene, a camera and a renderer. Independent instances can be used
+ * from different threads at the same time; calls on one instance must not overlap.
+ *
+ * Typical use:
+ *
+ *   halide_instance* instance = halide_create();
+ *   halide_set_scene(instance, &scene);
+ *   halide_set_resolution(instance, 1280, 720);
+ *   halide_set_camera(instance, position, forward, 45.0f);
+ *   halide_render(instance, 64, progress, user_data);
+ *   halide_get_buffer(instance, HALIDE_BUFFER_COLOR, &buffer);
+ *   halide_destroy(instance);
+ *
+ * Buffers are borrowed. They point straight into the renderer's accumulation and renders
+ * update them in place. They stay valid until the resolution changes, AOVs are switched off
+ * or the instance is destroyed. They hold sums over buffer.samples samples, in linear color,
+ * with rows from bottom to top.
+ *
+ * The interface only grows: existing functions, enum values and struct layouts do not change
+ * while HALIDE_API_VERSION stays the same major version.
+ */
+#ifndef HALIDE_C_H
+#define HALIDE_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(HALIDE_C_STATIC)
+	#define HALIDE_C_API
+#elif defined(_WIN32)
+	#ifdef HALIDE_C_BUILD
+		#define HALIDE_C_API __declspec(dllexport)
+	#else
+		#define HALIDE_C_API __declspec(dllimport)
+	#endif
+#else
+	#define HALIDE_C_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HALIDE_API_VERSION 1
+
+typedef struct halide_instance halide_instance;
+
+typedef enum halide_status
+{
+	HALIDE_OK = 0,
+	HALIDE_ERROR_INVALID_ARGUMENT = 1, /* Details from halide_get_last_error */
+	HALIDE_ERROR_NOT_READY = 2,        /* No scene, camera or resolution yet */
+	HALIDE_ERROR_CANCELLED = 3,        /* The progress callback stopped the render */
+	HALIDE_ERROR_INTERNAL = 4
+} halide_status;
+
+/* Scene description, copied by halide_set_scene. Indices refer into the arrays of the same
+ * description; vectors are x, y, z and colors linear r, g, b. */
+
+typedef enum halide_material_type
+{
+	HALIDE_MATERIAL_DIFFUSE = 0,
+	HALIDE_MATERIAL_METAL = 1,
+	/* 2 is reserved for dielectrics, which the renderer does not implement yet */
+	HALIDE_MATERIAL_EMISSIVE = 3
+} halide_material_type;
+
+typedef struct halide_material
+{
+	int32_t type;             /* halide_material_type */
+	float albedo[3];
+	float roughness;          /* Metal */
+	float emission_color[3];  /* Emissive, radiance is color * power */
+	float emission_power;
+} halide_material;
+
+typedef struct halide_sphere
+{
+	float position[3];
+	float radius;
+	int32_t material;
+} halide_sphere;
+
+/* Infinite, seen from both sides */
+typedef struct halide_plane
+{
+	float point[3];
+	float normal[3];
+	int32_t material;
+} halide_plane;
+
+/* Axis-aligned */
+typedef struct halide_box
+{
+	float min[3];
+	float max[3];
+	int32_t material;
+} halide_box;
+
+typedef struct halide_disc
+{
+	float center[3];
+	float normal[3];
+	float radius;
+	int32_t material;
+} halide_disc;
+
+/* Infinitely far away, color is the irradiance it delivers */
+typedef struct halide_distant_light
+{
+	float direction[3]; /* Direction the light travels in */
+	float color[3];
+} halide_distant_light;
+
+typedef struct halide_scene
+{
+	const halide_material* materials;
+	uint32_t material_count;
+	const halide_sphere* spheres;
+	uint32_t sphere_count;
+	const halide_plane* planes;
+	uint32_t plane_count;
+	const halide_box* boxes;
+	uint32_t box_count;
+	const halide_disc* discs;
+	uint32_t disc_count;
+	const halide_distant_light* lights;
+	uint32_t light_count;
+	float sky[3];             /* Radiance of rays that leave the scene, black when zeroed */
+} halide_scene;
+
+typedef enum halide_sampler
+{
+	HALIDE_SAMPLER_RANDOM = 0,
+	HALIDE_SAMPLER_SOBOL = 1,
+	HALIDE_SAMPLER_BLUE_NOISE = 2
+} halide_sampler;
+
+/* Start from halide_get_default_settings, fields keep their meaning across versions */
+typedef struct halide_settings
+{
+	uint32_t bounces;
+	int32_t sampler;          /* halide_sampler */
+	int32_t jitter_aa;        /* Sub-pixel anti-aliasing */
+	int32_t sample_lights;    /* Next-event estimation towards lights */
+	int32_t path_guiding;
+	int32_t aovs;             /* Fill the albedo, normal and depth buffers */
+} halide_settings;
+
+/* The AOV buffers need halide_settings.aovs, misses add zero to them */
+typedef enum halide_buffer_type
+{
+	HALIDE_BUFFER_COLOR = 0,  /* 4 channels, rgb and a weight of 1 per sample */
+	HALIDE_BUFFER_ALBEDO = 1, /* 3 channels, primary hit albedo */
+	HALIDE_BUFFER_NORMAL = 2, /* 3 channels, primary hit world normal */
+	HALIDE_BUFFER_DEPTH = 3   /* 1 channel, distance to the primary hit */
+} halide_buffer_type;
+
+typedef struct halide_buffer
+{
+	const float* data;   /* Borrowed, rows of width * channels floats without padding */
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t samples;    /* Divide by this for the estimate */
+} halide_buffer;
+
+/* Called on the rendering thread after every sample. Return nonzero to stop; samples
+ * rendered so far stay in the buffers. */
+typedef int (*halide_progress_callback)(void* user_data, uint32_t samples_done, uint32_t samples_requested);
+
+HALIDE_C_API uint32_t halide_get_api_version(void);
+
+HALIDE_C_API halide_instance* halide_create(void);
+HALIDE_C_API void halide_destroy(halide_instance* instance);
+/* Message for the last failed call on this instance, owned by the instance */
+HALIDE_C_API const char* halide_get_last_error(const halide_instance* instance);
+
+/* Replaces the whole scene and restarts accumulation */
+HALIDE_C_API halide_status halide_set_scene(halide_instance* instance, const halide_scene* scene);
+/* Vertical field of view in degrees, restarts accumulation. World up is +y, so forward must
+ * not be parallel to it. */
+HALIDE_C_API halide_status halide_set_camera(halide_instance* instance, const float position[3], const float forward[3], float vertical_fov);
+/* Restarts accumulation when the size changes */
+HALIDE_C_API halide_status halide_set_resolution(halide_instance* instance, uint32_t width, uint32_t height);
+
+HALIDE_C_API void halide_get_default_settings(halide_settings* settings);
+/* Restarts accumulation */
+HALIDE_C_API halide_status halide_set_settings(halide_instance* instance, const halide_settings* settings);
+
+/* Adds samples to the accumulation, progress may be NULL */
+HALIDE_C_API halide_status halide_render(halide_instance* instance, uint32_t samples, halide_progress_callback progress, void* user_data);
+/* Drops the accumulated samples, the next render starts over */
+HALIDE_C_API void halide_reset(halide_instance* instance);
+
+HALIDE_C_API halide_status halide_get_buffer(const halide_instance* instance, halide_buffer_type type, halide_buffer* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
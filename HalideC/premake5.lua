@@ -0,0 +1,61 @@
+newoption
+{
+   trigger = "halide-c-static",
+   description = "Build HalideC as a static library instead of a shared one"
+}
+
+project "HalideC"
+   if _OPTIONS["halide-c-static"] then
+      kind "StaticLib"
+      defines { "HALIDE_C_STATIC" }
+   else
+      kind "SharedLib"
+   end
+   language "C++"
+   cppdialect "C++17"
+   staticruntime "off"
+
+   -- Embeddable renderer core behind the C interface in include/HalideC.h
+   files
+   {
+      "include/**.h",
+      "src/**.cpp",
+      "../Halide/src/**.h",
+      "../Halide/src/**.cpp",
+   }
+   removefiles { "../Halide/src/WalnutApp.cpp" }
+
+   includedirs
+   {
+      "include",
+      "../Halide/src",
+      "../Walnut/vendor/glm",
+   }
+
+   -- Only the halide_* functions are exported from the shared library
+   defines { "HALIDE_HEADLESS", "HALIDE_C_BUILD" }
+   visibility "Hidden"
+
+   targetdir ("../bin/" .. outputdir .. "/%{prj.name}")
+   objdir ("../bin-int/" .. outputdir .. "/%{prj.name}")
+
+   filter "system:windows"
+      systemversion "latest"
+
+   filter "system:linux"
+      -- std::execution::par is backed by TBB in libstdc++
+      links { "tbb", "pthread" }
+
+   filter "configurations:Debug"
+      runtime "Debug"
+      symbols "On"
+
+   filter "configurations:Release"
+      runtime "Release"
+      optimize "On"
+      symbols "On"
+
+   filter "configurations:Dist"
+      runtime "Release"
+      optimize "On"
+      symbols "Off"
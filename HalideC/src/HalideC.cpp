@@ -0,0 +1,408 @@
+// C interface over Renderer, Camera and Scene. Every entry point catches exceptions so none
+// cross the C boundary, and reports failures through halide_status plus a per-instance message.
+
+#include "HalideC.h"
+
+#include "Renderer.h"
+#include "Camera.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct halide_instance
+{
+	// Scene holds raw pointers, the instance owns what they point to
+	std::unique_ptr<Scene> ActiveScene;
+	std::vector<std::unique_ptr<Material>> Materials;
+	std::vector<std::unique_ptr<Sphere>> Spheres;
+	std::vector<std::unique_ptr<Light>> Lights;
+
+	std::unique_ptr<Camera> ActiveCamera;
+
+	Renderer ActiveRenderer;
+	uint32_t Width = 0, Height = 0;
+
+	std::string LastError;
+};
+
+// Buffers are handed out as the renderer stores them
+static_assert(sizeof(glm::vec4) == 4 * sizeof(float) && sizeof(glm::vec3) == 3 * sizeof(float), "glm vectors must be tightly packed");
+static_assert((int)SamplerType::BlueNoise == HALIDE_SAMPLER_BLUE_NOISE, "halide_sampler mirrors SamplerType");
+
+static glm::vec3 ToVec3(const float v[3])
+{
+	return glm::vec3(v[0], v[1], v[2]);
+}
+
+static halide_status Fail(halide_instance* instance, halide_status status, const std::string& message)
+{
+	instance->LastError = message;
+	return status;
+}
+
+template<typename Fn>
+static halide_status Guarded(halide_instance* instance, Fn&& fn)
+{
+	if (!instance)
+		return HALIDE_ERROR_INVALID_ARGUMENT;
+	try
+	{
+		return fn();
+	}
+	catch (const std::exception& e)
+	{
+		return Fail(instance, HALIDE_ERROR_INTERNAL, e.what());
+	}
+	catch (...)
+	{
+		return Fail(instance, HALIDE_ERROR_INTERNAL, "unknown error");
+	}
+}
+
+static bool ValidMaterial(int32_t material, uint32_t count)
+{
+	return material >= 0 && (uint32_t)material < count;
+}
+
+static bool ValidArray(const void* data, uint32_t count)
+{
+	return data || count == 0;
+}
+
+// Also false for NaN components, which no direction can be normalized from
+static bool NonZero(const float v[3])
+{
+	float lengthSquared = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+	return lengthSquared > 0.0f && lengthSquared < INFINITY;
+}
+
+static halide_status ValidateScene(halide_instance* instance, const halide_scene& desc)
+{
+	if (!ValidArray(desc.materials, desc.material_count) || !ValidArray(desc.spheres, desc.sphere_count) ||
+		!ValidArray(desc.planes, desc.plane_count) || !ValidArray(desc.boxes, desc.box_count) ||
+		!ValidArray(desc.discs, desc.disc_count) || !ValidArray(desc.lights, desc.light_count))
+		return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "scene array is NULL but its count is not 0");
+
+	for (uint32_t i = 0; i < desc.material_count; i++)
+	{
+		int32_t type = desc.materials[i].type;
+		if (type == 2)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "material " + std::to_string(i) + " is a dielectric, which is not implemented");
+		if (type < HALIDE_MATERIAL_DIFFUSE || type > HALIDE_MATERIAL_EMISSIVE)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "material " + std::to_string(i) + " has an unknown type");
+	}
+
+	for (uint32_t i = 0; i < desc.light_count; i++)
+	{
+		if (!NonZero(desc.lights[i].direction))
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "light " + std::to_string(i) + " has no direction");
+	}
+
+	if (!(desc.sky[0] >= 0.0f && desc.sky[1] >= 0.0f && desc.sky[2] >= 0.0f) || !std::isfinite(desc.sky[0] + desc.sky[1] + desc.sky[2]))
+		return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "sky radiance must be finite and not negative");
+
+	// Degenerate shapes would give NaN normals or inverted bounds in the acceleration structures
+	auto invalid = [&](const char* kind, uint32_t index, const char* problem)
+	{
+		return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, std::string(kind) + " " + std::to_string(index) + " " + problem);
+	};
+	for (uint32_t i = 0; i < desc.sphere_count; i++)
+	{
+		if (!(desc.spheres[i].radius > 0.0f))
+			return invalid("sphere", i, "needs a positive radius");
+	}
+	for (uint32_t i = 0; i < desc.plane_count; i++)
+	{
+		if (!NonZero(desc.planes[i].normal))
+			return invalid("plane", i, "has no normal");
+	}
+	for (uint32_t i = 0; i < desc.box_count; i++)
+	{
+		const halide_box& box = desc.boxes[i];
+		if (!(box.min[0] <= box.max[0] && box.min[1] <= box.max[1] && box.min[2] <= box.max[2]))
+			return invalid("box", i, "has min above max");
+	}
+	for (uint32_t i = 0; i < desc.disc_count; i++)
+	{
+		if (!NonZero(desc.discs[i].normal))
+			return invalid("disc", i, "has no normal");
+		if (!(desc.discs[i].radius > 0.0f))
+			return invalid("disc", i, "needs a positive radius");
+	}
+
+	auto check = [&](const char* kind, uint32_t index, int32_t material)
+	{
+		if (ValidMaterial(material, desc.material_count))
+			return true;
+		instance->LastError = std::string(kind) + " " + std::to_string(index) + " uses material " +
+			std::to_string(material) + ", the scene has " + std::to_string(desc.material_count);
+		return false;
+	};
+	for (uint32_t i = 0; i < desc.sphere_count; i++)
+	{
+		if (!check("sphere", i, desc.spheres[i].material))
+			return HALIDE_ERROR_INVALID_ARGUMENT;
+	}
+	for (uint32_t i = 0; i < desc.plane_count; i++)
+	{
+		if (!check("plane", i, desc.planes[i].material))
+			return HALIDE_ERROR_INVALID_ARGUMENT;
+	}
+	for (uint32_t i = 0; i < desc.box_count; i++)
+	{
+		if (!check("box", i, desc.boxes[i].material))
+			return HALIDE_ERROR_INVALID_ARGUMENT;
+	}
+	for (uint32_t i = 0; i < desc.disc_count; i++)
+	{
+		if (!check("disc", i, desc.discs[i].material))
+			return HALIDE_ERROR_INVALID_ARGUMENT;
+	}
+	return HALIDE_OK;
+}
+
+static std::unique_ptr<Material> CreateMaterial(const halide_material& desc)
+{
+	glm::vec3 albedo = ToVec3(desc.albedo);
+	switch (desc.type)
+	{
+	case HALIDE_MATERIAL_METAL:      return std::make_unique<Metal>(albedo, desc.roughness);
+	case HALIDE_MATERIAL_EMISSIVE:   return std::make_unique<Emissive>(albedo, ToVec3(desc.emission_color), desc.emission_power);
+	default:                         return std::make_unique<Diffuse>(albedo);
+	}
+}
+
+extern "C" {
+
+uint32_t halide_get_api_version(void)
+{
+	return HALIDE_API_VERSION;
+}
+
+halide_instance* halide_create(void)
+{
+	try
+	{
+		halide_instance* instance = new halide_instance();
+		// halide_distant_light is the only way to light a scene through the API
+		instance->ActiveRenderer.GetSettings().DistantLights = true;
+		return instance;
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+void halide_destroy(halide_instance* instance)
+{
+	delete instance;
+}
+
+const char* halide_get_last_error(const halide_instance* instance)
+{
+	return instance ? instance->LastError.c_str() : "no instance";
+}
+
+halide_status halide_set_scene(halide_instance* instance, const halide_scene* desc)
+{
+	return Guarded(instance, [&]()
+	{
+		if (!desc)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "scene is NULL");
+		halide_status status = ValidateScene(instance, *desc);
+		if (status != HALIDE_OK)
+			return status;
+
+		// Built on the side, a failure leaves the previous scene in place
+		auto scene = std::make_unique<Scene>();
+		scene->SkyLight = ToVec3(desc->sky);
+		scene->UseSkyLight = true;
+		std::vector<std::unique_ptr<Material>> materials;
+		std::vector<std::unique_ptr<Sphere>> spheres;
+		std::vector<std::unique_ptr<Light>> lights;
+
+		for (uint32_t i = 0; i < desc->material_count; i++)
+		{
+			materials.push_back(CreateMaterial(desc->materials[i]));
+			scene->Materials.push_back(materials.back().get());
+		}
+		for (uint32_t i = 0; i < desc->sphere_count; i++)
+		{
+			const halide_sphere& sphere = desc->spheres[i];
+			spheres.push_back(std::make_unique<Sphere>(ToVec3(sphere.position), sphere.radius, sphere.material));
+			scene->Spheres.push_back(spheres.back().get());
+		}
+		for (uint32_t i = 0; i < desc->light_count; i++)
+		{
+			const halide_distant_light& light = desc->lights[i];
+			lights.push_back(std::make_unique<Light>(glm::normalize(ToVec3(light.direction)), ToVec3(light.color)));
+			scene->Lights.push_back(lights.back().get());
+		}
+
+		scene->Planes.reserve(desc->plane_count);
+		for (uint32_t i = 0; i < desc->plane_count; i++)
+			scene->Planes.emplace_back(ToVec3(desc->planes[i].point), ToVec3(desc->planes[i].normal), desc->planes[i].material);
+		scene->Boxes.reserve(desc->box_count);
+		for (uint32_t i = 0; i < desc->box_count; i++)
+			scene->Boxes.emplace_back(ToVec3(desc->boxes[i].min), ToVec3(desc->boxes[i].max), desc->boxes[i].material);
+		scene->Discs.reserve(desc->disc_count);
+		for (uint32_t i = 0; i < desc->disc_count; i++)
+			scene->Discs.emplace_back(ToVec3(desc->discs[i].center), ToVec3(desc->discs[i].normal), desc->discs[i].radius, desc->discs[i].material);
+
+		// The old objects go only after the scene that points to them
+		instance->ActiveScene = std::move(scene);
+		instance->Materials = std::move(materials);
+		instance->Spheres = std::move(spheres);
+		instance->Lights = std::move(lights);
+		instance->ActiveRenderer.ResetFrameIndex();
+		return HALIDE_OK;
+	});
+}
+
+halide_status halide_set_camera(halide_instance* instance, const float position[3], const float forward[3], float vertical_fov)
+{
+	return Guarded(instance, [&]()
+	{
+		if (!position || !forward)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "camera position or forward is NULL");
+		if (!std::isfinite(position[0]) || !std::isfinite(position[1]) || !std::isfinite(position[2]))
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "camera position must be finite");
+		glm::vec3 direction = ToVec3(forward);
+		if (!NonZero(forward) || !(vertical_fov > 0.0f && vertical_fov < 180.0f))
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "camera needs a nonzero forward and a field of view in (0, 180) degrees");
+		if (!Camera::IsValidForward(direction))
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "camera forward must not point straight up or down");
+
+		// The field of view is fixed at construction, a new camera also gets a new version
+		instance->ActiveCamera = std::make_unique<Camera>(vertical_fov, 0.1f, 100.0f);
+		instance->ActiveCamera->SetView(ToVec3(position), direction);
+		if (instance->Width > 0)
+			instance->ActiveCamera->OnResize(instance->Width, instance->Height);
+		instance->ActiveRenderer.ResetFrameIndex();
+		return HALIDE_OK;
+	});
+}
+
+halide_status halide_set_resolution(halide_instance* instance, uint32_t width, uint32_t height)
+{
+	return Guarded(instance, [&]()
+	{
+		if (width == 0 || height == 0)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "resolution must be at least 1x1");
+
+		instance->Width = width;
+		instance->Height = height;
+		instance->ActiveRenderer.OnResize(width, height);
+		if (instance->ActiveCamera)
+			instance->ActiveCamera->OnResize(width, height);
+		return HALIDE_OK;
+	});
+}
+
+void halide_get_default_settings(halide_settings* settings)
+{
+	if (!settings)
+		return;
+
+	Renderer::Settings defaults;
+	settings->bounces = (uint32_t)defaults.Bounces;
+	settings->sampler = (int32_t)defaults.Sampler;
+	settings->jitter_aa = defaults.JitterAA;
+	settings->sample_lights = defaults.SampleLights;
+	settings->path_guiding = defaults.PathGuiding;
+	settings->aovs = defaults.OutputAOVs;
+}
+
+halide_status halide_set_settings(halide_instance* instance, const halide_settings* settings)
+{
+	return Guarded(instance, [&]()
+	{
+		if (!settings)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "settings is NULL");
+		if (settings->bounces == 0)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "bounces must be at least 1");
+		if (settings->sampler < HALIDE_SAMPLER_RANDOM || settings->sampler > HALIDE_SAMPLER_BLUE_NOISE)
+			return Fail(instance, HALIDE_ERROR_INVALID_ARGUMENT, "unknown sampler " + std::to_string(settings->sampler));
+
+		Renderer::Settings& target = instance->ActiveRenderer.GetSettings();
+		target.Bounces = (int)std::min(settings->bounces, 1024u);
+		target.Sampler = (SamplerType)settings->sampler;
+		target.JitterAA = settings->jitter_aa != 0;
+		target.SampleLights = settings->sample_lights != 0;
+		target.PathGuiding = settings->path_guiding != 0;
+		target.OutputAOVs = settings->aovs != 0;
+		instance->ActiveRenderer.ResetFrameIndex();
+		return HALIDE_OK;
+	});
+}
+
+halide_status halide_render(halide_instance* instance, uint32_t samples, halide_progress_callback progress, void* user_data)
+{
+	return Guarded(instance, [&]()
+	{
+		if (!instance->ActiveScene || !instance->ActiveCamera || instance->Width == 0)
+			return Fail(instance, HALIDE_ERROR_NOT_READY, "set a scene, a camera and a resolution before rendering");
+
+		// Buffers hold linear sums for the caller, nothing is tone mapped
+		Renderer::Settings& settings = instance->ActiveRenderer.GetSettings();
+		settings.Accumulate = true;
+		settings.Gamma = false;
+
+		for (uint32_t i = 0; i < samples; i++)
+		{
+			instance->ActiveRenderer.Render(*instance->ActiveScene, *instance->ActiveCamera);
+			if (progress && progress(user_data, i + 1, samples) != 0)
+				return Fail(instance, HALIDE_ERROR_CANCELLED, "render cancelled after " + std::to_string(i + 1) + " samples");
+		}
+		return HALIDE_OK;
+	});
+}
+
+void halide_reset(halide_instance* instance)
+{
+	if (instance)
+		instance->ActiveRenderer.ResetFrameIndex();
+}
+
+halide_status halide_get_buffer(const halide_instance* instance, halide_buffer_type type, halide_buffer* buffer)
+{
+	halide_instance* mutableInstance = const_cast<halide_instance*>(instance);
+	return Guarded(mutableInstance, [&]()
+	{
+		if (!buffer)
+			return Fail(mutableInstance, HALIDE_ERROR_INVALID_ARGUMENT, "buffer is NULL");
+
+		const Renderer& renderer = instance->ActiveRenderer;
+		if (instance->Width == 0)
+			return Fail(mutableInstance, HALIDE_ERROR_NOT_READY, "no resolution set");
+
+		const float* data = nullptr;
+		uint32_t channels = 0;
+		switch (type)
+		{
+		case HALIDE_BUFFER_COLOR:  data = &renderer.GetAccumulationData()->x; channels = 4; break;
+		case HALIDE_BUFFER_ALBEDO: data = renderer.GetAlbedoData() ? &renderer.GetAlbedoData()->x : nullptr; channels = 3; break;
+		case HALIDE_BUFFER_NORMAL: data = renderer.GetNormalData() ? &renderer.GetNormalData()->x : nullptr; channels = 3; break;
+		case HALIDE_BUFFER_DEPTH:  data = renderer.GetDepthData(); channels = 1; break;
+		default:
+			return Fail(mutableInstance, HALIDE_ERROR_INVALID_ARGUMENT, "unknown buffer type " + std::to_string((int)type));
+		}
+		if (!data)
+			return Fail(mutableInstance, HALIDE_ERROR_NOT_READY, "AOV buffers are filled by renders with halide_settings.aovs set");
+
+		buffer->data = data;
+		buffer->width = renderer.GetWidth();
+		buffer->height = renderer.GetHeight();
+		buffer->channels = channels;
+		buffer->samples = renderer.GetSampleCount();
+		return HALIDE_OK;
+	});
+}
+
+}
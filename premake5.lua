@@ -7,4 +7,7 @@ workspace "Halide"
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 include "Walnut/WalnutExternal.lua"
 
-include "Halide"
\ No newline at end of file
+include "Halide"
+include "HalideBench"
+include "HalideBatch"
+include "HalideC"
\ No newline at end of file